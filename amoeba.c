@@ -41,6 +41,54 @@ static void am_initsymbol(am_Solver *solver, am_Symbol *sym, int type)
         *sym = am_newsymbol(solver, type);
 }
 
+static void *am_realloc(am_Solver *solver, void *ptr, size_t nsize,
+                        size_t osize)
+{
+    am_count(solver, bytes_allocated, nsize - osize);
+    return solver->allocf(solver->ud, ptr, nsize, osize);
+}
+
+/* A recording logs the public calls made on a solver, a byte for the call
+ * and then its arguments: ids and counts as varints, numbers as
+ * little-endian doubles.  Calls made inside another call are left out,
+ * replaying the outer one makes them again. */
+
+static am_Recorder *am_reclog(am_Solver *solver, int op)
+{
+    am_Recorder *rec = solver ? solver->recorder : NULL;
+    if (rec == NULL || rec->depth != 0)
+        return NULL;
+    putc(op, rec->fp);
+    return rec;
+}
+
+static void am_recuint(am_Recorder *rec, size_t v)
+{
+    for (; v >= 0x80; v >>= 7)
+        putc((int)(v & 0x7f) | 0x80, rec->fp);
+    putc((int)v, rec->fp);
+}
+
+static void am_recfloat(am_Recorder *rec, am_Float v)
+{
+    double d = (double)v;
+    uint64_t bits;
+    int i;
+    memcpy(&bits, &d, sizeof(bits));
+    for (i = 0; i < 8; ++i, bits >>= 8)
+        putc((int)(bits & 0xff), rec->fp);
+}
+
+static void am_recvar(am_Recorder *rec, am_Variable *var)
+{
+    am_recuint(rec, var ? am_Symbol_id(var->sym) : 0);
+}
+
+static void am_reccons(am_Recorder *rec, am_Constraint *cons)
+{
+    am_recuint(rec, cons ? am_Symbol_id(am_key(cons)) : 0);
+}
+
 static void am_initpool(am_MemPool *pool, size_t size)
 {
     pool->size = size;
@@ -53,7 +101,7 @@ static void am_freepool(am_Solver *solver, am_MemPool *pool)
     const size_t offset = AM_POOLSIZE - sizeof(void *);
     while (pool->pages != NULL) {
         void *next = *(void **)((char *)pool->pages + offset);
-        solver->allocf(solver->ud, pool->pages, 0, AM_POOLSIZE);
+        am_realloc(solver, pool->pages, 0, AM_POOLSIZE);
         pool->pages = next;
     }
     am_initpool(pool, pool->size);
@@ -64,7 +112,8 @@ static void *am_alloc(am_Solver *solver, am_MemPool *pool)
     void *obj = pool->freed;
     if (obj == NULL) {
         const size_t offset = AM_POOLSIZE - sizeof(void *);
-        void *end, *newpage = solver->allocf(solver->ud, NULL, AM_POOLSIZE, 0);
+        void *end, *newpage = am_realloc(solver, NULL, AM_POOLSIZE, 0);
+        am_probe3(pool_page, solver, pool->size, AM_POOLSIZE);
         *(void **)((char *)newpage + offset) = pool->pages;
         pool->pages = newpage;
         end = (char *)newpage + (offset / pool->size - 1) * pool->size;
@@ -135,7 +184,7 @@ static void am_freetable(am_Solver *solver, am_Table *t)
 {
     size_t size = t->size * t->entry_size;
     if (size)
-        solver->allocf(solver->ud, t->hash, 0, size);
+        am_realloc(solver, t->hash, 0, size);
     am_inittable(t, t->entry_size);
 }
 
@@ -143,9 +192,11 @@ static size_t am_resizetable(am_Solver *solver, am_Table *t, size_t len)
 {
     size_t i, oldsize = t->size * t->entry_size;
     am_Table nt = *t;
+    am_count(solver, table_resizes, 1);
     nt.size = am_hashsize(t, len);
+    am_probe5(table_resize, solver, t, t->size, nt.size, t->entry_size);
     nt.lastfree = nt.size * nt.entry_size;
-    nt.hash = (am_Entry *)solver->allocf(solver->ud, NULL, nt.lastfree, 0);
+    nt.hash = (am_Entry *)am_realloc(solver, NULL, nt.lastfree, 0);
     memset(nt.hash, 0, nt.size * nt.entry_size);
     for (i = 0; i < oldsize; i += nt.entry_size) {
         am_Entry *e = am_index(t->hash, i);
@@ -156,7 +207,7 @@ static size_t am_resizetable(am_Solver *solver, am_Table *t, size_t len)
         }
     }
     if (oldsize)
-        solver->allocf(solver->ud, t->hash, 0, oldsize);
+        am_realloc(solver, t->hash, 0, oldsize);
     *t = nt;
     return t->size;
 }
@@ -311,14 +362,15 @@ static void am_solvefor(am_Solver *solver, am_Row *row, am_Symbol entry,
         am_addvar(solver, row, exit, reciprocal);
 }
 
-static void am_substitute(am_Solver *solver, am_Row *row, am_Symbol entry,
-                          const am_Row *other)
+static int am_substitute(am_Solver *solver, am_Row *row, am_Symbol entry,
+                         const am_Row *other)
 {
     am_Term *term = (am_Term *)am_gettable(&row->terms, entry);
     if (!term)
-        return;
+        return 0;
     am_delkey(&row->terms, &term->entry);
     am_addrow(solver, row, other, term->multiplier);
+    return 1;
 }
 
 /* variables & constraints */
@@ -327,14 +379,38 @@ AM_API int am_variableid(am_Variable *var)
 {
     return var ? am_Symbol_id(var->sym) : -1;
 }
+static am_Variable *am_findroot(am_Variable *var, am_Float *scale,
+                                am_Float *offset)
+{
+    am_Variable *root = var;
+    am_Float m = 1.0f, k = 0.0f;
+    while (root->alias != NULL)
+        k += m * root->offset, m *= root->scale, root = root->alias;
+    if (root != var && var->alias != root) /* path compression */
+        var->alias = root, var->scale = m, var->offset = k;
+    *scale = m, *offset = k;
+    return root;
+}
+
 AM_API am_Float am_value(am_Variable *var)
 {
-    return var ? var->value : 0.0f;
+    am_Variable *root;
+    am_Float scale, offset;
+    if (var == NULL)
+        return 0.0f;
+    if (var->alias == NULL && !var->fixed)
+        return var->value;
+    root = am_findroot(var, &scale, &offset);
+    return scale * (root->fixed ? root->offset : root->value) + offset;
 }
 AM_API void am_usevariable(am_Variable *var)
 {
-    if (var)
-        ++var->refcount;
+    am_Recorder *rec;
+    if (var == NULL)
+        return;
+    ++var->refcount;
+    if ((rec = am_reclog(var->solver, AM_REC_USEVARIABLE)) != NULL)
+        am_recvar(rec, var);
 }
 
 static am_Variable *am_sym2var(am_Solver *solver, am_Symbol sym)
@@ -346,32 +422,42 @@ static am_Variable *am_sym2var(am_Solver *solver, am_Symbol sym)
 
 AM_API am_Variable *am_newvariable(am_Solver *solver)
 {
+    am_Recorder *rec;
     am_Variable *var = (am_Variable *)am_alloc(solver, &solver->varpool);
     am_Symbol sym = am_newsymbol(solver, AM_EXTERNAL);
     am_VarEntry *ve = (am_VarEntry *)am_settable(solver, &solver->vars, sym);
     assert(ve->variable == NULL);
     memset(var, 0, sizeof(*var));
     var->sym = sym;
+    var->lower = -AM_FLOAT_MAX;
+    var->upper = AM_FLOAT_MAX;
     var->refcount = 1;
     var->solver = solver;
     ve->variable = var;
+    if ((rec = am_reclog(solver, AM_REC_NEWVARIABLE)) != NULL)
+        am_recvar(rec, var);
     return var;
 }
 
-AM_API void am_delvariable(am_Variable *var)
+static void am_delvariable_impl(am_Variable *var)
 {
     if (var && --var->refcount <= 0) {
         am_Solver *solver = var->solver;
         am_VarEntry *e = (am_VarEntry *)am_gettable(&solver->vars, var->sym);
         assert(e != NULL);
         am_delkey(&solver->vars, &e->entry);
+        e = (am_VarEntry *)am_gettable(&solver->bounds, var->bound);
+        if (e != NULL)
+            am_delkey(&solver->bounds, &e->entry);
         am_remove(var->constraint);
+        ++solver->generation; /* memoized states may point to it */
         am_free(&solver->varpool, var);
     }
 }
 
 AM_API am_Constraint *am_newconstraint(am_Solver *solver, am_Float strength)
 {
+    am_Recorder *rec;
     am_Constraint *cons = (am_Constraint *)am_alloc(solver, &solver->conspool);
     memset(cons, 0, sizeof(*cons));
     cons->solver = solver;
@@ -380,10 +466,21 @@ AM_API am_Constraint *am_newconstraint(am_Solver *solver, am_Float strength)
     am_Symbol_set(&am_key(cons), ++solver->constraint_count, AM_EXTERNAL);
     ((am_ConsEntry *)am_settable(solver, &solver->constraints, am_key(cons)))
         ->constraint = cons;
+    if ((rec = am_reclog(solver, AM_REC_NEWCONSTRAINT)) != NULL)
+        am_reccons(rec, cons), am_recfloat(rec, cons->strength);
     return cons;
 }
 
-AM_API void am_delconstraint(am_Constraint *cons)
+static void am_freesense(am_Solver *solver, am_Constraint *cons)
+{
+    if (cons->sense != NULL)
+        am_realloc(solver, cons->sense, 0,
+                   cons->sense_size * sizeof(am_Sense));
+    cons->sense = NULL;
+    cons->sense_count = cons->sense_size = 0;
+}
+
+static void am_delconstraint_impl(am_Constraint *cons)
 {
     am_Solver *solver = cons ? cons->solver : NULL;
     am_Term *term = NULL;
@@ -397,11 +494,12 @@ AM_API void am_delconstraint(am_Constraint *cons)
     while (am_nextentry(&cons->expression.terms, (am_Entry **)&term))
         am_delvariable(am_sym2var(solver, am_key(term)));
     am_freerow(solver, &cons->expression);
+    am_freesense(solver, cons);
     am_free(&solver->conspool, cons);
 }
 
-AM_API am_Constraint *am_cloneconstraint(am_Constraint *other,
-                                         am_Float strength)
+static am_Constraint *am_cloneconstraint_impl(am_Constraint *other,
+                                              am_Float strength)
 {
     am_Constraint *cons;
     if (other == NULL)
@@ -413,8 +511,8 @@ AM_API am_Constraint *am_cloneconstraint(am_Constraint *other,
     return cons;
 }
 
-AM_API int am_mergeconstraint(am_Constraint *cons, am_Constraint *other,
-                              am_Float multiplier)
+static int am_mergeconstraint_impl(am_Constraint *cons, am_Constraint *other,
+                                   am_Float multiplier)
 {
     am_Term *term = NULL;
     if (cons == NULL || other == NULL || am_Symbol_id(cons->marker) != 0 ||
@@ -431,7 +529,7 @@ AM_API int am_mergeconstraint(am_Constraint *cons, am_Constraint *other,
     return AM_OK;
 }
 
-AM_API void am_resetconstraint(am_Constraint *cons)
+static void am_resetconstraint_impl(am_Constraint *cons)
 {
     am_Term *term = NULL;
     if (cons == NULL)
@@ -443,8 +541,8 @@ AM_API void am_resetconstraint(am_Constraint *cons)
     am_resetrow(&cons->expression);
 }
 
-AM_API int am_addterm(am_Constraint *cons, am_Variable *var,
-                      am_Float multiplier)
+static int am_addterm_impl(am_Constraint *cons, am_Variable *var,
+                           am_Float multiplier)
 {
     if (cons == NULL || var == NULL || am_Symbol_id(cons->marker) != 0 ||
         cons->solver != var->solver)
@@ -460,6 +558,10 @@ AM_API int am_addterm(am_Constraint *cons, am_Variable *var,
 
 AM_API int am_addconstant(am_Constraint *cons, am_Float constant)
 {
+    am_Recorder *rec = am_reclog(cons ? cons->solver : NULL,
+                                 AM_REC_ADDCONSTANT);
+    if (rec != NULL)
+        am_reccons(rec, cons), am_recfloat(rec, constant);
     if (cons == NULL || am_Symbol_id(cons->marker) != 0)
         return AM_FAILED;
     if (cons->relation == AM_GREATEQUAL)
@@ -471,7 +573,11 @@ AM_API int am_addconstant(am_Constraint *cons, am_Float constant)
 
 AM_API int am_setrelation(am_Constraint *cons, int relation)
 {
+    am_Recorder *rec = am_reclog(cons ? cons->solver : NULL,
+                                 AM_REC_SETRELATION);
     assert(relation >= AM_LESSEQUAL && relation <= AM_GREATEQUAL);
+    if (rec != NULL)
+        am_reccons(rec, cons), am_recuint(rec, (size_t)relation);
     if (cons == NULL || am_Symbol_id(cons->marker) != 0 || cons->relation != 0)
         return AM_FAILED;
     if (relation != AM_GREATEQUAL)
@@ -489,49 +595,344 @@ AM_API int am_hasedit(am_Variable *var)
 
 AM_API int am_hasconstraint(am_Constraint *cons)
 {
-    return cons != NULL && am_Symbol_id(cons->marker) != 0;
+    return cons != NULL && (am_Symbol_id(cons->marker) != 0 || cons->disabled);
+}
+
+AM_API int am_isdisabled(am_Constraint *cons)
+{
+    return cons != NULL && cons->disabled;
 }
 
 AM_API void am_autoupdate(am_Solver *solver, int auto_update)
 {
+    am_Recorder *rec = am_reclog(solver, AM_REC_AUTOUPDATE);
+    if (rec != NULL)
+        am_recuint(rec, auto_update != 0);
     solver->auto_update = auto_update;
 }
 
+static void am_markdirty(am_Solver *solver, am_Variable *var)
+{
+    if (am_Symbol_type(var->dirty_next) == AM_DUMMY)
+        return;
+    am_Symbol_set(&(var->dirty_next), am_Symbol_id(solver->dirty_vars), AM_DUMMY);
+    solver->dirty_vars = var->sym;
+}
+
+/* A variable with bounds enters the tableau as a restricted symbol: its
+ * value is lower + bound, or upper - bound once flipped to sit at its
+ * upper limit, so the lower limit costs no row and the upper one is
+ * checked by the ratio tests. */
+
+static am_Variable *am_boundvar(am_Solver *solver, am_Symbol sym)
+{
+    am_VarEntry *ve;
+    if (solver->bounds.count == 0 || !am_isslack(sym))
+        return NULL;
+    ve = (am_VarEntry *)am_gettable(&solver->bounds, sym);
+    return ve ? ve->variable : NULL;
+}
+
+static am_Float am_span(am_Variable *var)
+{
+    if (var->lower <= -AM_FLOAT_MAX || var->upper >= AM_FLOAT_MAX)
+        return AM_FLOAT_MAX;
+    return var->upper - var->lower;
+}
+
+static int am_overbound(am_Variable *var, am_Float value)
+{
+    am_Float span = am_span(var);
+    return value > span && !am_approx(value, span);
+}
+
+static am_Float am_violation(am_Solver *solver, am_Row *row)
+{
+    am_Variable *var = am_boundvar(solver, am_key(row));
+    am_Float over = var ? am_span(var) - row->constant : 0.0f;
+    return row->constant < over ? row->constant : over;
+}
+
+/* Infeasible rows are fixed in push order, which is cheap and good
+ * enough while all of them only have to rise.  With native bounds a row
+ * can be over its span as well, the push order is a poor guide there and
+ * leads to long chains of pivots, so those solvers keep the rows in a
+ * heap and fix the most violated first. */
+
+static void am_pushinfeasible(am_Solver *solver, am_Symbol sym,
+                              am_Float violation)
+{
+    am_Infeasible *heap = solver->infeasible_heap;
+    size_t i, size = solver->infeasible_size;
+    if (solver->infeasible_count == size) {
+        size_t newsize = size ? size * 2 : 64;
+        heap = (am_Infeasible *)am_realloc(solver, NULL,
+                newsize * sizeof(am_Infeasible), 0);
+        if (solver->infeasible_heap != NULL) {
+            memcpy(heap, solver->infeasible_heap, size * sizeof(am_Infeasible));
+            am_realloc(solver, solver->infeasible_heap, 0,
+                       size * sizeof(am_Infeasible));
+        }
+        solver->infeasible_heap = heap, solver->infeasible_size = newsize;
+    }
+    for (i = solver->infeasible_count++; i > 0; i = (i - 1) / 2) {
+        if (heap[(i - 1) / 2].violation <= violation)
+            break;
+        heap[i] = heap[(i - 1) / 2];
+    }
+    heap[i].row = sym, heap[i].violation = violation;
+}
+
+static am_Symbol am_popinfeasible(am_Solver *solver)
+{
+    am_Infeasible *heap = solver->infeasible_heap;
+    am_Infeasible last = heap[--solver->infeasible_count];
+    am_Symbol top = heap[0].row;
+    size_t i = 0, child, count = solver->infeasible_count;
+    while ((child = 2 * i + 1) < count) {
+        if (child + 1 < count && heap[child + 1].violation < heap[child].violation)
+            ++child;
+        if (heap[child].violation >= last.violation)
+            break;
+        heap[i] = heap[child], i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
 static void am_infeasible(am_Solver *solver, am_Row *row)
 {
     if (am_isdummy(row->infeasible_next))
         return;
+    if (solver->bounds.count != 0) {
+        am_Symbol_set(&(row->infeasible_next), 0, AM_DUMMY);
+        am_pushinfeasible(solver, am_key(row), am_violation(solver, row));
+        return;
+    }
     am_Symbol_set(&(row->infeasible_next), am_Symbol_id(solver->infeasible_rows), AM_DUMMY);
     solver->infeasible_rows = am_key(row);
 }
 
-static void am_markdirty(am_Solver *solver, am_Variable *var)
+static int am_hasinfeasible(am_Solver *solver)
 {
-    if (am_Symbol_type(var->dirty_next) == AM_DUMMY)
+    return am_Symbol_id(solver->infeasible_rows) != 0 ||
+           solver->infeasible_count != 0;
+}
+
+static void am_clearinfeasible(am_Solver *solver)
+{
+    solver->infeasible_rows = am_null();
+    solver->infeasible_count = 0;
+}
+
+static void am_markbound(am_Solver *solver, am_Symbol sym)
+{
+    am_Variable *var = am_boundvar(solver, sym);
+    if (var != NULL)
+        am_markdirty(solver, var);
+}
+
+static am_Float am_rowvalue(am_Solver *solver, am_Variable *var)
+{
+    int bounded = am_Symbol_id(var->bound) != 0;
+    am_Row *row;
+    am_Float value;
+    if (var->indiff)
+        return ((am_DiffNode *)am_gettable(&solver->diffnodes, var->sym))
+            ->value;
+    row = (am_Row *)am_gettable(&solver->rows,
+                                bounded ? var->bound : var->sym);
+    value = row ? row->constant : 0.0f;
+    if (!bounded)
+        return value;
+    return var->flipped ? var->upper - value : var->lower + value;
+}
+
+static am_Float am_tablevalue(am_Solver *solver, am_Variable *var)
+{
+    /* the value in the tableau now, before am_updatevars publishes it */
+    am_Float scale, offset;
+    am_Variable *root = am_findroot(var, &scale, &offset);
+    return scale * (root->fixed ? root->offset : am_rowvalue(solver, root))
+        + offset;
+}
+
+static void am_checkrow(am_Solver *solver, am_Row *row, am_Variable *var)
+{
+    /* row is restricted, var is its bound variable if any */
+    if (am_nearzero(row->constant))
+        row->constant = 0.0f; /* rounding must not make it infeasible */
+    if (row->constant < 0.0f || (var && am_overbound(var, row->constant)))
+        am_infeasible(solver, row);
+}
+
+static void am_touchrow(am_Solver *solver, am_Row *row)
+{
+    am_Variable *var;
+    if (am_isexternal(am_key(row))) {
+        am_markdirty(solver, am_sym2var(solver, am_key(row)));
         return;
-    am_Symbol_set(&(var->dirty_next), am_Symbol_id(solver->dirty_vars), AM_DUMMY);
-    solver->dirty_vars = var->sym;
+    }
+    if ((var = am_boundvar(solver, am_key(row))) != NULL)
+        am_markdirty(solver, var);
+    am_checkrow(solver, row, var);
+}
+
+/* The optional column index maps each symbol to the rows mentioning it,
+ * so that a pivot rewrites and ratio-tests only the rows of its column
+ * instead of looking the symbol up in every row.  It costs a second hash
+ * update whenever a row of the tableau gains or loses a term. */
+
+static void am_linkterm(am_Solver *solver, am_Symbol sym, am_Symbol row)
+{
+    am_Column *col = (am_Column *)am_settable(solver, &solver->columns, sym);
+    if (col->rows.entry_size == 0)
+        am_inittable(&col->rows, sizeof(am_Entry));
+    am_settable(solver, &col->rows, row);
+}
+
+static void am_unlinkterm(am_Solver *solver, am_Symbol sym, am_Symbol row)
+{
+    am_Column *col = (am_Column *)am_gettable(&solver->columns, sym);
+    am_Entry *entry;
+    if (col == NULL || (entry = (am_Entry *)am_gettable(&col->rows, row)) == NULL)
+        return;
+    am_delkey(&col->rows, entry);
+    if (col->rows.count == 0) {
+        am_freetable(solver, &col->rows);
+        am_delkey(&solver->columns, &col->entry);
+    }
+}
+
+static void am_linkrow(am_Solver *solver, am_Row *row, int link)
+{
+    am_Term *term = NULL;
+    if (!solver->indexed)
+        return;
+    while (am_nextentry(&row->terms, (am_Entry **)&term))
+        if (link)
+            am_linkterm(solver, am_key(term), am_key(row));
+        else
+            am_unlinkterm(solver, am_key(term), am_key(row));
+}
+
+static am_Table am_detachcolumn(am_Solver *solver, am_Symbol sym)
+{
+    am_Column *col = (am_Column *)am_gettable(&solver->columns, sym);
+    am_Table rows;
+    am_inittable(&rows, sizeof(am_Entry));
+    if (col != NULL) {
+        rows = col->rows;
+        am_delkey(&solver->columns, &col->entry);
+    }
+    return rows;
+}
+
+static void am_freecolumns(am_Solver *solver)
+{
+    am_Column *col = NULL;
+    while (am_nextentry(&solver->columns, (am_Entry **)&col))
+        am_freetable(solver, &col->rows);
+    am_freetable(solver, &solver->columns);
+}
+
+static am_Row *am_nextrowwith(am_Solver *solver, am_Symbol sym,
+                              am_Entry **cursor)
+{
+    /* the rows that can mention sym: its column, or every row */
+    const am_Column *col;
+    if (!solver->indexed)
+        return am_nextentry(&solver->rows, cursor) ? (am_Row *)*cursor : NULL;
+    col = (const am_Column *)am_gettable(&solver->columns, sym);
+    if (col == NULL || !am_nextentry(&col->rows, cursor))
+        return NULL;
+    return (am_Row *)am_gettable(&solver->rows, am_key(*cursor));
+}
+
+static void am_substitute_linked(am_Solver *solver, am_Row *row,
+                                 am_Symbol entry, const am_Row *other)
+{
+    am_Term *term = (am_Term *)am_gettable(&row->terms, entry), *oterm = NULL;
+    am_Float multiplier = term->multiplier;
+    am_delkey(&row->terms, &term->entry);
+    row->constant += other->constant * multiplier;
+    while (am_nextentry(&other->terms, (am_Entry **)&oterm)) {
+        am_Symbol sym = am_key(oterm);
+        am_Float value = oterm->multiplier * multiplier;
+        if ((term = (am_Term *)am_gettable(&row->terms, sym)) == NULL) {
+            if (am_nearzero(value))
+                continue;
+            term = (am_Term *)am_settable(solver, &row->terms, sym);
+            term->multiplier = value;
+            am_linkterm(solver, sym, am_key(row));
+        }
+        else if (am_nearzero(term->multiplier += value)) {
+            am_delkey(&row->terms, &term->entry);
+            am_unlinkterm(solver, sym, am_key(row));
+        }
+    }
 }
 
 static void am_substitute_rows(am_Solver *solver, am_Symbol var, am_Row *expr)
 {
     am_Row *row = NULL;
-    while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
-        am_substitute(solver, row, var, expr);
-        if (am_isexternal(am_key(row)))
-            am_markdirty(solver, am_sym2var(solver, am_key(row)));
-        else if (row->constant < 0.0f)
-            am_infeasible(solver, row);
+    ++solver->pivot_count;
+    ++solver->revision;
+    if (solver->indexed) {
+        am_Table rows = am_detachcolumn(solver, var);
+        am_Entry *entry = NULL;
+        am_count(solver, rows_scanned, rows.count);
+        am_count(solver, rows_modified, rows.count);
+        while (am_nextentry(&rows, &entry)) {
+            row = (am_Row *)am_gettable(&solver->rows, am_key(entry));
+            am_substitute_linked(solver, row, var, expr);
+            am_touchrow(solver, row);
+        }
+        am_freetable(solver, &rows);
+    }
+    else {
+        am_count(solver, rows_scanned, solver->rows.count);
+        while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
+            int hit = am_substitute(solver, row, var, expr);
+            am_count(solver, rows_modified, hit);
+            am_touchrow(solver, row);
+        }
     }
     am_substitute(solver, &solver->objective, var, expr);
 }
 
+static void am_flip(am_Solver *solver, am_Variable *var, am_Row *objective)
+{
+    am_Float span = am_span(var);
+    am_Row *row = (am_Row *)am_gettable(&solver->rows, var->bound);
+    assert(span < AM_FLOAT_MAX);
+    if (row != NULL) {
+        ++solver->revision;
+        am_multiply(row, -1.0f);
+        row->constant += span;
+    }
+    else {
+        am_Row flip; /* bound = span - bound */
+        am_initrow(&flip);
+        flip.constant = span;
+        am_addvar(solver, &flip, var->bound, -1.0f);
+        am_substitute_rows(solver, var->bound, &flip);
+        if (objective != NULL && objective != &solver->objective)
+            am_substitute(solver, objective, var->bound, &flip);
+        am_freerow(solver, &flip);
+    }
+    var->flipped = !var->flipped;
+    am_markdirty(solver, var);
+}
+
 static int am_getrow(am_Solver *solver, am_Symbol sym, am_Row *dst)
 {
     am_Row *row = (am_Row *)am_gettable(&solver->rows, sym);
     am_key(dst) = am_null();
     if (row == NULL)
         return AM_FAILED;
+    ++solver->revision;
+    am_linkrow(solver, row, 0);
     am_delkey(&solver->rows, &row->entry);
     dst->constant = row->constant;
     dst->terms = row->terms;
@@ -541,8 +942,10 @@ static int am_getrow(am_Solver *solver, am_Symbol sym, am_Row *dst)
 static int am_putrow(am_Solver *solver, am_Symbol sym, const am_Row *src)
 {
     am_Row *row = (am_Row *)am_settable(solver, &solver->rows, sym);
+    ++solver->revision;
     row->constant = src->constant;
     row->terms = src->terms;
+    am_linkrow(solver, row, 1);
     return AM_OK;
 }
 
@@ -556,15 +959,59 @@ static void am_mergerow(am_Solver *solver, am_Row *row, am_Symbol var,
         am_addvar(solver, row, var, multiplier);
 }
 
+static void am_resetbudget(am_Solver *solver)
+{
+    solver->pivots_left = solver->budget ? solver->budget : ~0u;
+}
+
+static int am_usepivot(am_Solver *solver)
+{
+    if (solver->pivots_left == 0)
+        return 0;
+    --solver->pivots_left;
+    return 1;
+}
+
+/* Trace events go to solver->tracef; callers test it first, so a solver
+ * nobody listens to pays one branch per pivot. */
+
+static int am_traceop(am_Solver *solver, int kind, int what,
+                      am_Constraint *cons, am_Variable *var, int ret)
+{
+    am_TraceEvent ev;
+    if (solver->tracef == NULL)
+        return ret;
+    memset(&ev, 0, sizeof(ev));
+    ev.kind = kind, ev.what = what, ev.result = ret;
+    ev.constraint = cons, ev.variable = var;
+    ev.rows = solver->rows.count;
+    solver->tracef(solver->trace_ud, &ev);
+    return ret;
+}
+
+static void am_tracepivot(am_Solver *solver, int phase, am_Symbol enter,
+                          am_Symbol exit, const am_Row *row, am_Float ratio)
+{
+    am_TraceEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.kind = AM_TRACE_PIVOT, ev.what = phase;
+    ev.entering = am_Symbol_id(enter), ev.leaving = am_Symbol_id(exit);
+    ev.row_terms = row->terms.count, ev.rows = solver->rows.count;
+    ev.ratio = ratio;
+    solver->tracef(solver->trace_ud, &ev);
+}
+
 static int am_optimize(am_Solver *solver, am_Row *objective)
 {
     for (;;) {
         am_Symbol enter = am_null(), exit = am_null();
         am_Float r, min_ratio = AM_FLOAT_MAX;
-        am_Row tmp, *row = NULL;
+        am_Variable *var, *upper = NULL;
+        am_Row tmp, *row;
+        am_Entry *cursor = NULL;
         am_Term *term = NULL;
 
-        assert(am_Symbol_id(solver->infeasible_rows) == 0);
+        assert(!am_hasinfeasible(solver));
         while (am_nextentry(&objective->terms, (am_Entry **)&term)) {
             if (!am_isdummy(am_key(term)) && term->multiplier < 0.0f) {
                 enter = am_key(term);
@@ -573,27 +1020,54 @@ static int am_optimize(am_Solver *solver, am_Row *objective)
         }
         if (am_Symbol_id(enter) == 0)
             return AM_OK;
+        if (objective == &solver->objective && !am_usepivot(solver))
+            return AM_INCOMPLETE;
 
-        while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
+        /* the entering variable may reach its own upper bound first */
+        var = am_boundvar(solver, enter);
+        if (var != NULL && am_span(var) < AM_FLOAT_MAX)
+            min_ratio = am_span(var), exit = enter, upper = var;
+        while ((row = am_nextrowwith(solver, enter, &cursor)) != NULL) {
             term = (am_Term *)am_gettable(&row->terms, enter);
-            if (term == NULL || !am_ispivotable(am_key(row)) ||
-                term->multiplier > 0.0f)
+            if (term == NULL || !am_ispivotable(am_key(row)))
+                continue;
+            var = NULL;
+            if (term->multiplier < 0.0f)
+                r = -row->constant / term->multiplier;
+            else if ((var = am_boundvar(solver, am_key(row))) != NULL &&
+                     am_span(var) < AM_FLOAT_MAX)
+                r = (am_span(var) - row->constant) / term->multiplier;
+            else
                 continue;
-            r = -row->constant / term->multiplier;
             if (r < min_ratio ||
                 (am_approx(r, min_ratio) && am_Symbol_id(am_key(row)) < am_Symbol_id(exit)))
-                min_ratio = r, exit = am_key(row);
+                min_ratio = r, exit = am_key(row), upper = var;
         }
         assert(am_Symbol_id(exit) != 0);
         if (am_Symbol_id(exit) == 0)
             return AM_FAILED;
+        if (upper != NULL) {
+            am_flip(solver, upper, objective);
+            if (am_Symbol_id(exit) == am_Symbol_id(enter))
+                continue; /* a bound flip needs no pivot */
+        }
 
+        am_count(solver, primal_pivots, 1);
         am_getrow(solver, exit, &tmp);
+        am_probe6(pivot, solver, objective == &solver->objective ?
+                  AM_TRACE_PRIMAL : AM_TRACE_ARTIFICIAL, am_Symbol_id(enter),
+                  am_Symbol_id(exit), tmp.terms.count, solver->rows.count);
+        if (solver->tracef != NULL)
+            am_tracepivot(solver, objective == &solver->objective ?
+                          AM_TRACE_PRIMAL : AM_TRACE_ARTIFICIAL,
+                          enter, exit, &tmp, min_ratio);
         am_solvefor(solver, &tmp, enter, exit);
         am_substitute_rows(solver, enter, &tmp);
         if (objective != &solver->objective)
             am_substitute(solver, objective, enter, &tmp);
         am_putrow(solver, enter, &tmp);
+        am_markbound(solver, enter);
+        am_markbound(solver, exit);
     }
 }
 
@@ -604,8 +1078,23 @@ static am_Row am_makerow(am_Solver *solver, am_Constraint *cons)
     am_initrow(&row);
     row.constant = cons->expression.constant;
     while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
-        am_markdirty(solver, am_sym2var(solver, am_key(term)));
-        am_mergerow(solver, &row, am_key(term), term->multiplier);
+        am_Float scale, offset;
+        am_Variable *root = am_findroot(am_sym2var(solver, am_key(term)),
+                                        &scale, &offset);
+        row.constant += term->multiplier * offset;
+        if (root->fixed) {
+            row.constant += term->multiplier * scale * root->offset;
+            continue;
+        }
+        root->intableau = 1;
+        am_markdirty(solver, root);
+        if (am_Symbol_id(root->bound) != 0) {
+            am_Float m = term->multiplier * scale;
+            row.constant += m * (root->flipped ? root->upper : root->lower);
+            am_mergerow(solver, &row, root->bound, root->flipped ? -m : m);
+            continue;
+        }
+        am_mergerow(solver, &row, root->sym, term->multiplier * scale);
     }
     if (cons->relation != AM_EQUAL) {
         am_initsymbol(solver, &cons->marker, AM_SLACK);
@@ -633,15 +1122,23 @@ static am_Row am_makerow(am_Solver *solver, am_Constraint *cons)
     return row;
 }
 
-static void am_remove_errors(am_Solver *solver, am_Constraint *cons)
+static void am_reweight(am_Solver *solver, am_Constraint *cons,
+                        am_Float multiplier)
 {
     if (am_iserror(cons->marker))
-        am_mergerow(solver, &solver->objective, cons->marker, -cons->strength);
+        am_mergerow(solver, &solver->objective, cons->marker, multiplier);
     if (am_iserror(cons->other))
-        am_mergerow(solver, &solver->objective, cons->other, -cons->strength);
+        am_mergerow(solver, &solver->objective, cons->other, multiplier);
     if (am_isconstant(&solver->objective))
         solver->objective.constant = 0.0f;
+}
+
+static void am_remove_errors(am_Solver *solver, am_Constraint *cons)
+{
+    if (!cons->disabled) /* disabled errors carry no weight */
+        am_reweight(solver, cons, -cons->strength);
     cons->marker = cons->other = am_null();
+    cons->disabled = 0;
 }
 
 static int am_add_with_artificial(am_Solver *solver, am_Row *row,
@@ -651,6 +1148,7 @@ static int am_add_with_artificial(am_Solver *solver, am_Row *row,
     am_Term *term = NULL;
     am_Row tmp;
     int ret;
+    am_count(solver, artificials, 1);
     --solver->symbol_count; /* artificial variable will be removed */
     am_initrow(&tmp);
     am_addrow(solver, &tmp, row, 1.0f);
@@ -661,6 +1159,17 @@ static int am_add_with_artificial(am_Solver *solver, am_Row *row,
     am_freerow(solver, &tmp);
     if (am_getrow(solver, a, &tmp) == AM_OK) {
         am_Symbol entry = am_null();
+        if (ret != AM_OK) {
+            /* drop it as is, pivoting it out without a ratio test could
+             * leave other rows infeasible; the caller still gives back
+             * the symbols of the row, so am_remove mustn't refactor */
+            unsigned refactoring = solver->refactoring;
+            am_freerow(solver, &tmp);
+            solver->refactoring = 1;
+            am_remove(cons);
+            solver->refactoring = refactoring;
+            return ret;
+        }
         if (am_isconstant(&tmp)) {
             am_freerow(solver, &tmp);
             return ret;
@@ -674,14 +1183,31 @@ static int am_add_with_artificial(am_Solver *solver, am_Row *row,
             am_freerow(solver, &tmp);
             return AM_UNBOUND;
         }
+        am_probe6(pivot, solver, AM_TRACE_ARTIFICIAL, am_Symbol_id(entry),
+                  am_Symbol_id(a), tmp.terms.count, solver->rows.count);
+        if (solver->tracef != NULL)
+            am_tracepivot(solver, AM_TRACE_ARTIFICIAL, entry, a, &tmp, 0.0f);
         am_solvefor(solver, &tmp, entry, a);
         am_substitute_rows(solver, entry, &tmp);
         am_putrow(solver, entry, &tmp);
+        am_markbound(solver, entry);
     }
-    while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
-        term = (am_Term *)am_gettable(&row->terms, a);
-        if (term)
+    if (solver->indexed) {
+        am_Table rows = am_detachcolumn(solver, a);
+        am_Entry *entry = NULL;
+        while (am_nextentry(&rows, &entry)) {
+            row = (am_Row *)am_gettable(&solver->rows, am_key(entry));
+            term = (am_Term *)am_gettable(&row->terms, a);
             am_delkey(&row->terms, &term->entry);
+        }
+        am_freetable(solver, &rows);
+    }
+    else {
+        while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
+            term = (am_Term *)am_gettable(&row->terms, a);
+            if (term)
+                am_delkey(&row->terms, &term->entry);
+        }
     }
     term = (am_Term *)am_gettable(&solver->objective.terms, a);
     if (term)
@@ -691,15 +1217,53 @@ static int am_add_with_artificial(am_Solver *solver, am_Row *row,
     return ret;
 }
 
-static int am_try_addrow(am_Solver *solver, am_Row *row, am_Constraint *cons)
+static am_Symbol am_choose_external(am_Solver *solver, am_Row *row)
 {
+    /* Markowitz: all candidates share the row, so the one the fewest other
+     * rows mention needs the fewest substitutions and fills in least */
     am_Symbol subject = am_null();
-    am_Term *term = NULL;
-    while (am_nextentry(&row->terms, (am_Entry **)&term))
-        if (am_isexternal(am_key(term))) {
-            subject = am_key(term);
-            break;
+    am_Term *term = NULL, *count = NULL;
+    am_Float min_count = AM_FLOAT_MAX;
+    am_Row *other = NULL;
+    am_Table counts;
+    am_inittable(&counts, sizeof(am_Term));
+    while (am_nextentry(&row->terms, (am_Entry **)&term)) {
+        if (!am_isexternal(am_key(term)))
+            continue;
+        if (am_Symbol_id(subject) == 0) {
+            subject = am_key(term); /* the only candidate needs no counts */
+            continue;
+        }
+        if (counts.count == 0)
+            am_settable(solver, &counts, subject);
+        am_settable(solver, &counts, am_key(term));
+    }
+    if (counts.count == 0)
+        return subject;
+    if (solver->indexed) {
+        while (am_nextentry(&counts, (am_Entry **)&count)) {
+            const am_Column *col = (const am_Column *)am_gettable(
+                    &solver->columns, am_key(count));
+            count->multiplier = col ? (am_Float)col->rows.count : 0.0f;
         }
+    }
+    else {
+        while (am_nextentry(&solver->rows, (am_Entry **)&other))
+            while (am_nextentry(&counts, (am_Entry **)&count))
+                if (am_gettable(&other->terms, am_key(count)) != NULL)
+                    count->multiplier += 1.0f;
+    }
+    while (am_nextentry(&counts, (am_Entry **)&count))
+        if (count->multiplier < min_count)
+            min_count = count->multiplier, subject = am_key(count);
+    am_freetable(solver, &counts);
+    return subject;
+}
+
+static int am_try_addrow(am_Solver *solver, am_Row *row, am_Constraint *cons)
+{
+    am_Symbol subject = am_choose_external(solver, row);
+    am_Term *term = NULL;
     if (am_Symbol_id(subject) == 0 && am_ispivotable(cons->marker)) {
         am_Term *mterm = (am_Term *)am_gettable(&row->terms, cons->marker);
         if (mterm->multiplier < 0.0f)
@@ -728,38 +1292,93 @@ static int am_try_addrow(am_Solver *solver, am_Row *row, am_Constraint *cons)
     am_solvefor(solver, row, subject, am_null());
     am_substitute_rows(solver, subject, row);
     am_putrow(solver, subject, row);
+    if (am_isexternal(subject)) /* may not be a term of cons itself */
+        am_markdirty(solver, am_sym2var(solver, subject));
     return AM_OK;
 }
 
-static am_Symbol am_get_leaving_row(am_Solver *solver, am_Symbol marker)
+static am_Symbol am_get_leaving_row(am_Solver *solver, am_Symbol marker,
+                                    am_Variable **upper)
 {
     am_Symbol first = am_null(), second = am_null(), third = am_null();
+    am_Variable *upper1 = NULL, *upper2 = NULL;
     am_Float r1 = AM_FLOAT_MAX, r2 = AM_FLOAT_MAX;
-    am_Row *row = NULL;
-    while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
+    am_Entry *cursor = NULL;
+    am_Row *row;
+    while ((row = am_nextrowwith(solver, marker, &cursor)) != NULL) {
         am_Term *term = (am_Term *)am_gettable(&row->terms, marker);
+        am_Variable *var;
+        am_Float r, span;
         if (term == NULL)
             continue;
-        if (am_isexternal(am_key(row)))
+        if (am_isexternal(am_key(row))) {
             third = am_key(row);
-        else if (term->multiplier < 0.0f) {
-            am_Float r = -row->constant / term->multiplier;
+            continue;
+        }
+        /* rows moving towards an upper bound limit the other direction */
+        var = am_boundvar(solver, am_key(row));
+        span = var ? am_span(var) : AM_FLOAT_MAX;
+        if (term->multiplier < 0.0f) {
+            r = -row->constant / term->multiplier;
             if (r < r1)
-                r1 = r, first = am_key(row);
+                r1 = r, first = am_key(row), upper1 = NULL;
+            r = (span - row->constant) / -term->multiplier;
+            if (span < AM_FLOAT_MAX && r < r2)
+                r2 = r, second = am_key(row), upper2 = var;
         }
         else {
-            am_Float r = row->constant / term->multiplier;
+            r = row->constant / term->multiplier;
             if (r < r2)
-                r2 = r, second = am_key(row);
+                r2 = r, second = am_key(row), upper2 = NULL;
+            r = (span - row->constant) / term->multiplier;
+            if (span < AM_FLOAT_MAX && r < r1)
+                r1 = r, first = am_key(row), upper1 = var;
         }
     }
+    *upper = am_Symbol_id(first) ? upper1 : am_Symbol_id(second) ? upper2 : NULL;
     return am_Symbol_id(first) ? first : am_Symbol_id(second) ? second : third;
 }
 
+/* An edit's marker column is cached as (row, multiplier) pairs, so a
+ * suggest that needs no pivot is one pass over an array.  Any change to
+ * the shape of the tableau bumps solver->revision and drops the cache. */
+
+static void am_buildsense(am_Solver *solver, am_Constraint *cons)
+{
+    am_Entry *cursor = NULL;
+    am_Row *row;
+    cons->sense_count = 0;
+    while ((row = am_nextrowwith(solver, cons->marker, &cursor)) != NULL) {
+        am_Term *term = (am_Term *)am_gettable(&row->terms, cons->marker);
+        am_Sense *sense;
+        if (term == NULL)
+            continue;
+        if (cons->sense_count == cons->sense_size) {
+            unsigned size = cons->sense_size ? cons->sense_size * 2 : 8;
+            am_Sense *grown = (am_Sense *)am_realloc(solver, NULL,
+                    size * sizeof(am_Sense), 0);
+            if (cons->sense != NULL) {
+                memcpy(grown, cons->sense, cons->sense_count * sizeof(am_Sense));
+                am_realloc(solver, cons->sense, 0,
+                           cons->sense_size * sizeof(am_Sense));
+            }
+            cons->sense = grown, cons->sense_size = size;
+        }
+        sense = &cons->sense[cons->sense_count++];
+        sense->row = row;
+        sense->multiplier = term->multiplier;
+        sense->var = am_isexternal(am_key(row)) ?
+            am_sym2var(solver, am_key(row)) : am_boundvar(solver, am_key(row));
+    }
+    cons->sense_revision = solver->revision;
+}
+
 static void am_delta_edit_constant(am_Solver *solver, am_Float delta,
                                    am_Constraint *cons)
 {
     am_Row *row;
+    unsigned i;
+    cons->expression.constant -= delta; /* so the row can be rebuilt */
     if ((row = (am_Row *)am_gettable(&solver->rows, cons->marker)) != NULL) {
         if ((row->constant -= delta) < 0.0f)
             am_infeasible(solver, row);
@@ -770,246 +1389,2887 @@ static void am_delta_edit_constant(am_Solver *solver, am_Float delta,
             am_infeasible(solver, row);
         return;
     }
-    while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
-        am_Term *term = (am_Term *)am_gettable(&row->terms, cons->marker);
-        if (term == NULL)
-            continue;
-        row->constant += term->multiplier * delta;
-        if (am_isexternal(am_key(row)))
-            am_markdirty(solver, am_sym2var(solver, am_key(row)));
-        else if (row->constant < 0.0f)
-            am_infeasible(solver, row);
+    if (cons->sense_revision != solver->revision)
+        am_buildsense(solver, cons);
+    for (i = 0; i < cons->sense_count; ++i) {
+        am_Sense *sense = &cons->sense[i];
+        row = sense->row;
+        row->constant += sense->multiplier * delta;
+        if (sense->var != NULL)
+            am_markdirty(solver, sense->var);
+        if (!am_isexternal(am_key(row)))
+            am_checkrow(solver, row, sense->var);
     }
 }
 
-static void am_dual_optimize(am_Solver *solver)
+static am_Row *am_nextinfeasible(am_Solver *solver)
 {
-    while (am_Symbol_id(solver->infeasible_rows) != 0) {
-        am_Row tmp, *row = (am_Row *)am_gettable(&solver->rows,
-                                                 solver->infeasible_rows);
-        am_Symbol enter = am_null(), exit = am_key(row), curr;
-        am_Term *objterm, *term = NULL;
-        am_Float r, min_ratio = AM_FLOAT_MAX;
+    am_Row *row;
+    if (solver->infeasible_count == 0) {
+        row = (am_Row *)am_gettable(&solver->rows, solver->infeasible_rows);
         solver->infeasible_rows = row->infeasible_next;
-        row->infeasible_next = am_null();
-        if (row->constant >= 0.0f)
-            continue;
-        while (am_nextentry(&row->terms, (am_Entry **)&term)) {
-            if (am_isdummy(curr = am_key(term)) || term->multiplier <= 0.0f)
-                continue;
-            objterm = (am_Term *)am_gettable(&solver->objective.terms, curr);
-            r = objterm ? objterm->multiplier / term->multiplier : 0.0f;
-            if (min_ratio > r)
-                min_ratio = r, enter = curr;
-        }
-        assert(am_Symbol_id(enter) != 0);
-        am_getrow(solver, exit, &tmp);
-        am_solvefor(solver, &tmp, enter, exit);
-        am_substitute_rows(solver, enter, &tmp);
-        am_putrow(solver, enter, &tmp);
+        return row;
+    }
+    for (;;) {
+        /* pivots moved the constants since the push: a row that got
+         * better than the next one goes back with its current violation */
+        am_Symbol sym = am_popinfeasible(solver);
+        am_Float violation;
+        row = (am_Row *)am_gettable(&solver->rows, sym);
+        violation = am_violation(solver, row);
+        if (solver->infeasible_count == 0 ||
+            violation <= solver->infeasible_heap[0].violation)
+            return row;
+        am_pushinfeasible(solver, sym, violation);
     }
 }
 
-static void *am_default_allocf(void *ud, void *ptr, size_t nsize, size_t osize)
+static void am_dual_pivot(am_Solver *solver, am_Row *row)
 {
-    void *newptr;
-    (void)ud, (void)osize;
-    if (nsize == 0) {
-        free(ptr);
-        return NULL;
+    /* row must rise: enter the column that costs the objective least */
+    am_Row tmp;
+    am_Symbol enter = am_null(), exit = am_key(row), curr;
+    am_Term *objterm, *term = NULL;
+    am_Float r, min_ratio = AM_FLOAT_MAX;
+    while (am_nextentry(&row->terms, (am_Entry **)&term)) {
+        if (am_isdummy(curr = am_key(term)) || term->multiplier <= 0.0f)
+            continue;
+        objterm = (am_Term *)am_gettable(&solver->objective.terms, curr);
+        r = objterm ? objterm->multiplier / term->multiplier : 0.0f;
+        if (min_ratio > r)
+            min_ratio = r, enter = curr;
     }
-    newptr = realloc(ptr, nsize);
-    if (newptr == NULL)
-        abort();
-    return newptr;
+    assert(am_Symbol_id(enter) != 0);
+    am_count(solver, dual_pivots, 1);
+    am_getrow(solver, exit, &tmp);
+    am_probe6(pivot, solver, AM_TRACE_DUAL, am_Symbol_id(enter),
+              am_Symbol_id(exit), tmp.terms.count, solver->rows.count);
+    if (solver->tracef != NULL)
+        am_tracepivot(solver, AM_TRACE_DUAL, enter, exit, &tmp, min_ratio);
+    am_solvefor(solver, &tmp, enter, exit);
+    am_substitute_rows(solver, enter, &tmp);
+    am_putrow(solver, enter, &tmp);
+    am_markbound(solver, exit);
+    am_touchrow(solver, (am_Row *)am_gettable(&solver->rows, enter));
 }
 
-AM_API am_Solver *am_newsolver(am_Allocf *allocf, void *ud)
+static int am_dual_optimize(am_Solver *solver)
 {
-    am_Solver *solver;
-    if (allocf == NULL)
-        allocf = am_default_allocf;
-    if ((solver = (am_Solver *)allocf(ud, NULL, sizeof(am_Solver), 0)) == NULL)
+    while (am_hasinfeasible(solver)) {
+        am_Row *row = am_nextinfeasible(solver);
+        am_Variable *var = am_boundvar(solver, am_key(row));
+        int over = var != NULL && am_overbound(var, row->constant);
+        row->infeasible_next = am_null();
+        if ((row->constant < 0.0f || over) && !am_usepivot(solver)) {
+            am_infeasible(solver, row); /* keep it for am_resume */
+            return AM_INCOMPLETE;
+        }
+        if (over)
+            am_flip(solver, var, NULL); /* now below its lower bound */
+        if (row->constant < 0.0f)
+            am_dual_pivot(solver, row);
+    }
+    return AM_OK;
+}
+
+/* With a pivot budget a call may stop early and return AM_INCOMPLETE, or
+ * leave am_incomplete true when it returns nothing (am_suggest).  An
+ * unfinished primal phase leaves a feasible but not yet optimal tableau;
+ * an unfinished dual phase leaves infeasible rows, so am_updatevars keeps
+ * publishing the last feasible values until am_resume completes it. */
+
+static int am_solve(am_Solver *solver)
+{
+    int ret = am_optimize(solver, &solver->objective);
+    solver->incomplete = (ret == AM_INCOMPLETE);
+    if (solver->auto_update)
+        am_updatevars(solver);
+    return ret;
+}
+
+static void am_checkrefactor(am_Solver *solver);
+
+static void am_settle(am_Solver *solver)
+{
+    /* structural changes start from an optimal tableau, so finish
+     * whatever a bounded call left behind before granting a new budget */
+    ++solver->generation;
+    solver->pivots_left = ~0u;
+    am_dual_optimize(solver);
+    if (solver->incomplete)
+        am_optimize(solver, &solver->objective), solver->incomplete = 0;
+    am_checkrefactor(solver);
+    am_resetbudget(solver);
+}
+
+/* Presolve keeps required equalities over one or two variables out of the
+ * tableau: the constraint turns a variable that no row references yet into
+ * an alias (scale * root + offset) of another, or fixes it to a constant.
+ * am_makerow folds the aliases into every row it builds and am_value
+ * resolves them.  Rows built that way don't record which links they went
+ * through, so removing a presolved constraint rebuilds the tableau from
+ * the constraint expressions. */
+
+/* Frozen variables are fixed at the value they had, like presolved ones,
+ * and stay fixed across rebuilds.  A constraint over frozen variables only
+ * is a constant: it is checked once and kept out of the tableau, with a
+ * dummy marker and no row, until a thaw rebuilds it from its expression. */
+
+static int am_isfrozen(am_Solver *solver, am_Constraint *cons)
+{
+    am_Term *term = NULL;
+    if (solver->frozen_count == 0 || cons->expression.terms.count == 0)
+        return 0;
+    while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
+        am_Float scale, offset;
+        am_Variable *root = am_findroot(am_sym2var(solver, am_key(term)),
+                                        &scale, &offset);
+        if (!root->fixed)
+            return 0;
+    }
+    return 1;
+}
+
+static int am_freeze_cons(am_Solver *solver, am_Constraint *cons, int *ret)
+{
+    am_Term *term = NULL;
+    am_Float constant = cons->expression.constant;
+    if (!am_isfrozen(solver, cons))
+        return 0;
+    while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
+        am_Float scale, offset;
+        am_Variable *root = am_findroot(am_sym2var(solver, am_key(term)),
+                                        &scale, &offset);
+        constant += term->multiplier * (scale * root->offset + offset);
+    }
+    *ret = AM_OK;
+    if (cons->strength >= AM_REQUIRED && !am_nearzero(constant) &&
+            (cons->relation == AM_EQUAL || constant < 0.0f))
+        *ret = AM_UNSATISFIED;
+    else
+        am_initsymbol(solver, &cons->marker, AM_DUMMY);
+    return 1;
+}
+
+static int am_canalias(am_Variable *var)
+{
+    return !var->intableau && !var->indiff && var->followers == NULL &&
+           am_Symbol_id(var->bound) == 0;
+}
+
+static int am_presolve_cons(am_Solver *solver, am_Constraint *cons)
+{
+    am_Variable *root[2], *child;
+    am_Float mult[2], scale, offset, constant = cons->expression.constant;
+    am_Term *term = NULL;
+    int c, n = 0;
+    if (!solver->presolve || cons->relation != AM_EQUAL ||
+        cons->strength < AM_REQUIRED || cons->expression.terms.count > 2)
+        return 0;
+    while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
+        am_Variable *r = am_findroot(am_sym2var(solver, am_key(term)), &scale,
+                                     &offset);
+        constant += term->multiplier * offset;
+        if (r->fixed)
+            constant += term->multiplier * scale * r->offset;
+        else
+            root[n] = r, mult[n++] = term->multiplier * scale;
+    }
+    if (n == 0 || (n == 2 && root[0] == root[1]))
+        return 0; /* redundant or contradictory, let the tableau decide */
+    c = am_canalias(root[0]) ? 0 : 1;
+    if (c >= n || !am_canalias(child = root[c]))
+        return 0;
+    child->offset = -constant / mult[c];
+    if (n == 1)
+        child->fixed = 1;
+    else
+        child->alias = root[1 - c], child->scale = -mult[1 - c] / mult[c];
+    am_initsymbol(solver, &cons->marker, AM_DUMMY);
+    cons->presolved = child->sym;
+    return 1;
+}
+
+/* Required constraints of the form x - y >= c (or == c) over variables no
+ * row references are kept out of the tableau as edges y -> x of weight c
+ * in a difference graph.  Each variable in the graph takes the smallest
+ * value >= 0 that its edges allow, the longest path to it, and am_rowvalue
+ * reads it from there.  Adding an edge only raises values: starting from
+ * its head, the raises are settled in decreasing order, Dijkstra style,
+ * since with the old values as potentials no edge can make one grow.  A
+ * raise that comes back to the tail of the edge means a positive cycle,
+ * which is backed out as an unsatisfiable constraint.  Removing an edge
+ * only lowers the values it held up, directly or through other tight
+ * edges, which are recomputed the same way.  A constraint that would link
+ * a graph variable into the tableau moves the whole connected component
+ * of the graph into it first. */
+
+static int am_add_row(am_Solver *solver, am_Constraint *cons);
+static int am_bulk_addrow(am_Solver *solver, am_Table *seen,
+                          am_Constraint *cons);
+
+static am_DiffNode *am_diffnode(am_Solver *solver, am_Variable *var)
+{
+    return (am_DiffNode *)am_gettable(&solver->diffnodes, var->sym);
+}
+
+static void am_diffreserve(am_Solver *solver, am_DiffStep **steps,
+                           size_t count, size_t *size)
+{
+    size_t newsize = *size ? *size * 2 : 64;
+    am_DiffStep *grown;
+    if (count < *size)
+        return;
+    grown = (am_DiffStep *)am_realloc(solver, NULL,
+            newsize * sizeof(am_DiffStep), 0);
+    if (*steps != NULL) {
+        memcpy(grown, *steps, count * sizeof(am_DiffStep));
+        am_realloc(solver, *steps, 0, *size * sizeof(am_DiffStep));
+    }
+    *steps = grown, *size = newsize;
+}
+
+static void am_difflog(am_Solver *solver, am_DiffNode *node)
+{
+    am_DiffStep *step;
+    am_diffreserve(solver, &solver->diff_undo, solver->undo_count,
+                   &solver->undo_size);
+    step = &solver->diff_undo[solver->undo_count++];
+    step->node = node, step->change = node->value;
+}
+
+static void am_diffpush(am_Solver *solver, am_DiffNode *node,
+                        am_Float change)
+{
+    am_DiffStep *heap;
+    size_t i;
+    am_diffreserve(solver, &solver->diff_heap, solver->heap_count,
+                   &solver->heap_size);
+    heap = solver->diff_heap;
+    node->change = change;
+    for (i = solver->heap_count++; i > 0; i = (i - 1) / 2) {
+        if (heap[(i - 1) / 2].change >= change)
+            break;
+        heap[i] = heap[(i - 1) / 2];
+    }
+    heap[i].node = node, heap[i].change = change;
+}
+
+static am_DiffNode *am_diffpop(am_Solver *solver)
+{
+    am_DiffStep *heap = solver->diff_heap;
+    am_DiffStep last = heap[--solver->heap_count];
+    am_DiffNode *top = heap[0].node;
+    size_t i = 0, child, count = solver->heap_count;
+    while ((child = 2 * i + 1) < count) {
+        if (child + 1 < count && heap[child + 1].change > heap[child].change)
+            ++child;
+        if (heap[child].change <= last.change)
+            break;
+        heap[i] = heap[child], i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static int am_diffsettle(am_Solver *solver, am_DiffNode *stop, int region)
+{
+    /* region: only nodes the pass reached may change, else any can rise */
+    unsigned pass = solver->diff_pass;
+    while (solver->heap_count != 0) {
+        am_DiffNode *node = am_diffpop(solver);
+        am_DiffEdge *edge = NULL;
+        if (node->settled == pass)
+            continue;
+        if (node == stop) {
+            solver->heap_count = 0;
+            return 0;
+        }
+        node->settled = pass;
+        am_difflog(solver, node);
+        node->value += node->change;
+        am_markdirty(solver, node->var);
+        while (am_nextentry(&node->out, (am_Entry **)&edge)) {
+            am_DiffNode *next = am_diffnode(solver, edge->var);
+            am_Float change = node->value + edge->weight - next->value;
+            if (next->settled == pass)
+                continue;
+            if (next->pass != pass) {
+                if (region)
+                    continue;
+                next->pass = pass, next->change = 0.0f;
+            }
+            if (change > next->change && !am_approx(change, next->change))
+                am_diffpush(solver, next, change);
+        }
+    }
+    return 1;
+}
+
+static int am_diffraise(am_Solver *solver, am_DiffNode *from,
+                        am_DiffNode *to, am_Float weight)
+{
+    am_Float change = from->value + weight - to->value;
+    if (change <= 0.0f || am_nearzero(change))
+        return 1;
+    to->pass = ++solver->diff_pass;
+    am_diffpush(solver, to, change);
+    return am_diffsettle(solver, from, 0);
+}
+
+static void am_difflink(am_Solver *solver, am_Constraint *cons,
+                        am_DiffNode *from, am_DiffNode *to, am_Float weight)
+{
+    am_DiffEdge *edge;
+    edge = (am_DiffEdge *)am_settable(solver, &from->out, am_key(cons));
+    edge->var = to->var, edge->weight = weight;
+    edge = (am_DiffEdge *)am_settable(solver, &to->in, am_key(cons));
+    edge->var = from->var, edge->weight = weight;
+}
+
+static void am_diffdrop(am_Solver *solver, am_DiffNode *node)
+{
+    am_freetable(solver, &node->out);
+    am_freetable(solver, &node->in);
+    node->var->indiff = 0;
+    am_markdirty(solver, node->var);
+    am_delkey(&solver->diffnodes, &node->entry);
+}
+
+static void am_diffunlink(am_Solver *solver, am_Constraint *cons)
+{
+    am_Term *term = NULL;
+    while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
+        am_DiffNode *node = am_diffnode(solver,
+                                        am_sym2var(solver, am_key(term)));
+        am_Entry *edge;
+        if (node == NULL)
+            continue;
+        if ((edge = (am_Entry *)am_gettable(&node->out, am_key(cons))))
+            am_delkey(&node->out, edge);
+        if ((edge = (am_Entry *)am_gettable(&node->in, am_key(cons))))
+            am_delkey(&node->in, edge);
+        if (node->out.count == 0 && node->in.count == 0)
+            am_diffdrop(solver, node);
+    }
+}
+
+static void am_diffclear(am_Solver *solver)
+{
+    am_DiffNode *node = NULL;
+    while (am_nextentry(&solver->diffnodes, (am_Entry **)&node)) {
+        am_freetable(solver, &node->out);
+        am_freetable(solver, &node->in);
+        node->var->indiff = 0;
+        am_markdirty(solver, node->var);
+    }
+    am_freetable(solver, &solver->diffnodes);
+}
+
+static int am_diff_cons(am_Solver *solver, am_Constraint *cons, int *ret)
+{
+    am_Variable *var[2];
+    am_Float mult[2], weight;
+    am_DiffNode *from, *to;
+    am_Term *term = NULL;
+    int i, n = 0, ok;
+    if (!solver->diffsolve || cons->strength < AM_REQUIRED ||
+        cons->expression.terms.count != 2)
+        return 0;
+    while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
+        am_Variable *v = am_sym2var(solver, am_key(term));
+        if (v->alias != NULL || v->fixed || v->intableau ||
+            am_Symbol_id(v->bound) != 0)
+            return 0;
+        var[n] = v, mult[n++] = term->multiplier;
+    }
+    if (!am_approx(mult[0], -mult[1]))
+        return 0;
+    i = mult[0] > 0.0f ? 0 : 1;
+    /* var[i] >= var[1 - i] + weight, and <= it as well for an equality */
+    weight = -cons->expression.constant / mult[i];
+    for (n = 0; n < 2; ++n) {
+        am_DiffNode *node = (am_DiffNode *)am_settable(solver,
+                &solver->diffnodes, var[n]->sym);
+        if (node->var == NULL) {
+            am_inittable(&node->out, sizeof(am_DiffEdge));
+            am_inittable(&node->in, sizeof(am_DiffEdge));
+            node->var = var[n], var[n]->indiff = 1;
+            am_markdirty(solver, var[n]);
+        }
+    }
+    from = am_diffnode(solver, var[1 - i]), to = am_diffnode(solver, var[i]);
+    am_difflink(solver, cons, from, to, weight);
+    if (cons->relation == AM_EQUAL)
+        am_difflink(solver, cons, to, from, -weight);
+    solver->undo_count = 0;
+    ok = am_diffraise(solver, from, to, weight);
+    if (ok && cons->relation == AM_EQUAL)
+        ok = am_diffraise(solver, to, from, -weight);
+    if (!ok) {
+        while (solver->undo_count != 0) {
+            am_DiffStep *step = &solver->diff_undo[--solver->undo_count];
+            step->node->value = step->change;
+        }
+        am_diffunlink(solver, cons);
+        *ret = AM_UNSATISFIED;
+        return 1;
+    }
+    am_initsymbol(solver, &cons->marker, AM_DUMMY);
+    cons->indiff = 1;
+    *ret = AM_OK;
+    return 1;
+}
+
+static int am_difftight(am_Solver *solver, am_DiffNode *node,
+                        am_DiffEdge *edge)
+{
+    /* edge comes into node and holds the value where it is */
+    am_DiffNode *prev = am_diffnode(solver, edge->var);
+    return am_approx(node->value, prev->value + edge->weight);
+}
+
+static void am_diffremove(am_Solver *solver, am_Constraint *cons)
+{
+    unsigned pass = ++solver->diff_pass;
+    am_Variable *heads[2];
+    am_Term *term = NULL;
+    size_t i, n = 0;
+    while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
+        am_Variable *var = am_sym2var(solver, am_key(term));
+        am_DiffNode *node = am_diffnode(solver, var);
+        am_DiffEdge *edge = (am_DiffEdge *)am_gettable(&node->in,
+                                                       am_key(cons));
+        if (edge != NULL && am_difftight(solver, node, edge))
+            heads[n++] = var;
+    }
+    am_diffunlink(solver, cons);
+    cons->indiff = 0;
+    /* only values held up by the edges, directly or through other tight
+     * edges, can drop */
+    solver->undo_count = solver->heap_count = 0;
+    for (i = 0; i < n; ++i) {
+        am_DiffNode *node = am_diffnode(solver, heads[i]);
+        if (node != NULL && node->pass != pass)
+            node->pass = pass, am_difflog(solver, node);
+    }
+    for (i = 0; i < solver->undo_count; ++i) {
+        am_DiffEdge *edge = NULL;
+        while (am_nextentry(&solver->diff_undo[i].node->out,
+                            (am_Entry **)&edge)) {
+            am_DiffNode *next = am_diffnode(solver, edge->var);
+            am_DiffEdge *back = (am_DiffEdge *)am_gettable(&next->in,
+                                                           am_key(edge));
+            if (next->pass != pass && am_difftight(solver, next, back))
+                next->pass = pass, am_difflog(solver, next);
+        }
+    }
+    for (i = 0; i < solver->undo_count; ++i) {
+        am_DiffNode *node = solver->diff_undo[i].node;
+        am_DiffEdge *edge = NULL;
+        am_Float change = -node->value;
+        while (am_nextentry(&node->in, (am_Entry **)&edge)) {
+            am_DiffNode *prev = am_diffnode(solver, edge->var);
+            am_Float c = prev->value + edge->weight - node->value;
+            if (prev->pass != pass && c > change)
+                change = c;
+        }
+        am_diffpush(solver, node, change);
+    }
+    solver->undo_count = 0;
+    am_diffsettle(solver, NULL, 1);
+}
+
+static void am_diffrelease(am_Solver *solver, am_Table *seen,
+                           am_Constraint *cons)
+{
+    unsigned pass = ++solver->diff_pass;
+    am_ConsEntry *ce = NULL;
+    am_Term *term = NULL;
+    am_Table moved;
+    am_inittable(&moved, sizeof(am_ConsEntry));
+    solver->heap_count = 0;
+    while (am_nextentry(&cons->expression.terms, (am_Entry **)&term)) {
+        am_Float scale, offset;
+        am_Variable *root = am_findroot(am_sym2var(solver, am_key(term)),
+                                        &scale, &offset);
+        am_DiffNode *node;
+        if (!root->indiff || (node = am_diffnode(solver, root))->pass == pass)
+            continue;
+        node->pass = pass, am_diffpush(solver, node, 0.0f);
+        while (solver->heap_count != 0) {
+            am_Table *edges[2];
+            int k;
+            node = solver->diff_heap[--solver->heap_count].node;
+            edges[0] = &node->out, edges[1] = &node->in;
+            for (k = 0; k < 2; ++k) {
+                am_DiffEdge *edge = NULL;
+                while (am_nextentry(edges[k], (am_Entry **)&edge)) {
+                    am_DiffNode *next = am_diffnode(solver, edge->var);
+                    ((am_ConsEntry *)am_settable(solver, &moved,
+                        am_key(edge)))->constraint = ((am_ConsEntry *)
+                        am_gettable(&solver->constraints, am_key(edge)))
+                        ->constraint;
+                    if (next != NULL && next->pass != pass)
+                        next->pass = pass, am_diffpush(solver, next, 0.0f);
+                }
+            }
+            node->var->intableau = 1; /* keeps its edges from coming back */
+            am_diffdrop(solver, node);
+        }
+    }
+    while (am_nextentry(&moved, (am_Entry **)&ce)) {
+        am_Constraint *other = ce->constraint;
+        int ret;
+        other->indiff = 0, other->marker = am_null();
+        ret = seen ? am_bulk_addrow(solver, seen, other)
+                   : am_add_row(solver, other);
+        if (ret != AM_OK)
+            am_initsymbol(solver, &other->marker, AM_DUMMY);
+    }
+    am_freetable(solver, &moved);
+}
+
+static void am_unlinkvars(am_Solver *solver)
+{
+    am_Entry *entry = NULL;
+    while (am_nextentry(&solver->vars, &entry)) {
+        am_Variable *var = ((am_VarEntry *)entry)->variable;
+        var->value = am_value(var);
+    }
+    while (am_nextentry(&solver->vars, &entry)) {
+        am_Variable *var = ((am_VarEntry *)entry)->variable;
+        var->alias = NULL, var->fixed = var->frozen;
+    }
+}
+
+static void am_resetvars(am_Solver *solver)
+{
+    am_Entry *entry = NULL;
+    while (am_nextentry(&solver->vars, &entry)) {
+        am_Variable *var = ((am_VarEntry *)entry)->variable;
+        var->intableau = 0;
+        var->flipped = var->lower <= -AM_FLOAT_MAX;
+    }
+}
+
+/* Bulk loading skips the substitution pass that dominates incremental
+ * adds: a row whose subject no other row mentions yet goes into the
+ * tableau as it is.  Subjects are picked to keep it that way, preferring
+ * an external variable new to the tableau, or the fresh slack or error
+ * symbol of a row without external variables.  Other rows take the usual
+ * am_try_addrow path.  Optimizing stays per row, and only when the new
+ * row leaves the objective improvable: deferring it to the end starts the
+ * simplex from a poor basis whose pivots fill the rows in. */
+
+static void am_markseen(am_Solver *solver, am_Table *seen, am_Row *row)
+{
+    am_Term *term = NULL;
+    while (am_nextentry(&row->terms, (am_Entry **)&term))
+        am_settable(solver, seen, am_key(term));
+}
+
+static am_Symbol am_freshsubject(am_Table *seen, am_Row *row,
+                                 am_Constraint *cons)
+{
+    am_Term *term = NULL;
+    int external = 0;
+    while (am_nextentry(&row->terms, (am_Entry **)&term)) {
+        if (!am_isexternal(am_key(term)))
+            continue;
+        if (am_gettable(seen, am_key(term)) == NULL)
+            return am_key(term);
+        external = 1;
+    }
+    if (external) /* only an external variable may be its subject */
+        return am_null();
+    if (am_ispivotable(cons->marker)) {
+        term = (am_Term *)am_gettable(&row->terms, cons->marker);
+        if (term->multiplier < 0.0f)
+            return cons->marker;
+    }
+    if (am_ispivotable(cons->other)) {
+        term = (am_Term *)am_gettable(&row->terms, cons->other);
+        if (term->multiplier < 0.0f)
+            return cons->other;
+    }
+    return am_null();
+}
+
+static int am_improvable(am_Solver *solver, am_Row *row)
+{
+    am_Term *term = NULL;
+    while (am_nextentry(&row->terms, (am_Entry **)&term)) {
+        am_Term *objterm = (am_Term *)am_gettable(&solver->objective.terms,
+                                                  am_key(term));
+        if (objterm && !am_isdummy(am_key(term)) && objterm->multiplier < 0.0f)
+            return 1;
+    }
+    return 0;
+}
+
+static int am_bulk_addrow(am_Solver *solver, am_Table *seen,
+                          am_Constraint *cons)
+{
+    int ret, oldsym = solver->symbol_count;
+    am_Symbol subject;
+    am_Row row;
+    if (am_freeze_cons(solver, cons, &ret))
+        return ret;
+    if (am_presolve_cons(solver, cons))
+        return AM_OK;
+    if (am_diff_cons(solver, cons, &ret))
+        return ret;
+    am_diffrelease(solver, seen, cons);
+    row = am_makerow(solver, cons);
+    subject = am_freshsubject(seen, &row, cons);
+    am_markseen(solver, seen, &row);
+    if (am_Symbol_id(subject) == 0) {
+        if ((ret = am_try_addrow(solver, &row, cons)) != AM_OK) {
+            am_remove_errors(solver, cons);
+            solver->symbol_count = oldsym;
+            return ret;
+        }
+        am_optimize(solver, &solver->objective);
+        return AM_OK;
+    }
+    am_solvefor(solver, &row, subject, am_null());
+    am_substitute(solver, &solver->objective, subject, &row);
+    am_putrow(solver, subject, &row);
+    if (am_isexternal(subject))
+        am_markdirty(solver, am_sym2var(solver, subject));
+    /* only the terms of the new row can have made the objective worse */
+    if (am_improvable(solver,
+                      (am_Row *)am_gettable(&solver->rows, subject)))
+        am_optimize(solver, &solver->objective);
+    return AM_OK;
+}
+
+static void am_initseen(am_Solver *solver, am_Table *seen)
+{
+    am_Row *row = NULL;
+    am_inittable(seen, sizeof(am_Entry));
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        am_markseen(solver, seen, row);
+}
+
+static int am_rebuild(am_Solver *solver)
+{
+    am_Entry *entry = NULL;
+    am_Table seen;
+    unsigned refactoring = solver->refactoring;
+    int failed = AM_OK;
+    /* adding rows back settles the tableau, which mustn't refactor it
+     * again halfway through */
+    solver->refactoring = 1;
+    solver->pivot_count = 0;
+    am_unlinkvars(solver);
+    am_resetvars(solver);
+    am_diffclear(solver);
+    while (am_nextentry(&solver->rows, &entry)) {
+        am_delkey(&solver->rows, entry);
+        am_freerow(solver, (am_Row *)entry);
+    }
+    ++solver->revision;
+    am_freecolumns(solver);
+    am_resetrow(&solver->objective);
+    am_clearinfeasible(solver);
+    solver->pivots_left = ~0u;
+    am_inittable(&seen, sizeof(am_Entry));
+    while (am_nextentry(&solver->constraints, &entry)) {
+        am_Constraint *cons = ((am_ConsEntry *)entry)->constraint;
+        int ret;
+        if (am_Symbol_id(cons->marker) == 0)
+            continue;
+        cons->marker = cons->other = cons->presolved = am_null();
+        cons->indiff = 0;
+        if ((ret = am_bulk_addrow(solver, &seen, cons)) != AM_OK) {
+            /* keep it marked so that a rebuild after undoing the change
+             * that made it fail adds it back */
+            am_initsymbol(solver, &cons->marker, AM_DUMMY);
+            failed = ret;
+            continue;
+        }
+        if (cons->disabled)
+            am_reweight(solver, cons, -cons->strength);
+    }
+    am_freetable(solver, &seen);
+    am_optimize(solver, &solver->objective);
+    am_resetbudget(solver);
+    solver->pivot_count = 0;
+    solver->refactoring = refactoring;
+    return failed;
+}
+
+/* Refactoring rebuilds the rows from the constraint expressions for the
+ * basis the tableau already has, dropping the fill-in and the rounding
+ * that pivots leave behind.  Each row is solved for the basic symbol in
+ * it with the largest coefficient, so the result is the same tableau up
+ * to rounding and normally needs no pivots afterwards.  If the rows don't
+ * match the basis any more it falls back to am_rebuild. */
+
+static am_Symbol am_basic_subject(am_Table *basis, am_Row *row)
+{
+    am_Symbol subject = am_null();
+    am_Float max = 0.0f;
+    am_Term *term = NULL;
+    while (am_nextentry(&row->terms, (am_Entry **)&term)) {
+        am_Float m = term->multiplier < 0.0f ? -term->multiplier
+                                             : term->multiplier;
+        if (m > max && am_gettable(basis, am_key(term)) != NULL)
+            max = m, subject = am_key(term);
+    }
+    return subject;
+}
+
+static int am_isredundant(am_Row *row)
+{
+    am_Term *term = NULL;
+    while (am_nextentry(&row->terms, (am_Entry **)&term))
+        if (!am_isdummy(am_key(term)))
+            return 0;
+    return am_nearzero(row->constant);
+}
+
+static int am_refactor_rows(am_Solver *solver, am_Table *basis)
+{
+    am_Entry *entry = NULL;
+    am_Table seen;
+    int ret = AM_OK;
+    am_inittable(&seen, sizeof(am_Entry));
+    while (am_nextentry(&solver->constraints, &entry)) {
+        am_Constraint *cons = ((am_ConsEntry *)entry)->constraint;
+        am_Symbol subject;
+        am_Row row;
+        int fresh;
+        if (am_Symbol_id(cons->marker) == 0 ||
+            am_Symbol_id(cons->presolved) != 0 || cons->indiff ||
+            am_isfrozen(solver, cons))
+            continue;
+        row = am_makerow(solver, cons);
+        if (cons->disabled)
+            am_reweight(solver, cons, -cons->strength);
+        subject = am_basic_subject(basis, &row);
+        if (am_Symbol_id(subject) == 0) {
+            /* dropped by am_add_with_artificial when it was added */
+            if (!am_isredundant(&row))
+                ret = AM_FAILED;
+            am_freerow(solver, &row);
+            if (ret != AM_OK)
+                break;
+            continue;
+        }
+        fresh = am_gettable(&seen, subject) == NULL;
+        am_markseen(solver, &seen, &row);
+        am_solvefor(solver, &row, subject, am_null());
+        if (fresh)
+            am_substitute(solver, &solver->objective, subject, &row);
+        else
+            am_substitute_rows(solver, subject, &row);
+        am_putrow(solver, subject, &row);
+    }
+    am_freetable(solver, &seen);
+    return ret;
+}
+
+static int am_refactor_solver(am_Solver *solver)
+{
+    am_Entry *entry = NULL;
+    am_Row *row = NULL;
+    am_Table basis;
+    int ret;
+    solver->refactoring = 1;
+    solver->pivot_count = 0;
+    am_inittable(&basis, sizeof(am_Entry));
+    while (am_nextentry(&solver->rows, &entry)) {
+        am_settable(solver, &basis, am_key(entry));
+        am_delkey(&solver->rows, entry);
+        am_freerow(solver, (am_Row *)entry);
+    }
+    ++solver->revision;
+    am_freecolumns(solver);
+    am_resetrow(&solver->objective);
+    am_clearinfeasible(solver);
+    ret = am_refactor_rows(solver, &basis);
+    am_freetable(solver, &basis);
+    if (ret != AM_OK)
+        ret = am_rebuild(solver);
+    else {
+        while (am_nextentry(&solver->rows, (am_Entry **)&row))
+            am_touchrow(solver, row);
+        solver->pivots_left = ~0u;
+        am_dual_optimize(solver); /* only rounding can leave anything */
+        am_optimize(solver, &solver->objective);
+        solver->pivot_count = 0;
+    }
+    solver->refactoring = 0;
+    return ret;
+}
+
+static void am_checkrefactor(am_Solver *solver)
+{
+    if (solver->refactor_interval != 0 && !solver->refactoring &&
+        solver->pivot_count >= solver->refactor_interval &&
+        !am_hasinfeasible(solver) && !solver->incomplete)
+        am_refactor_solver(solver);
+}
+
+/* The memo keeps the solutions of recently visited edit states.  A
+ * suggest that lands on one leaves the infeasible rows on the list, as a
+ * budgeted dual phase would, and am_updatevars publishes the stored
+ * values instead of the tableau's; the next call that needs the tableau
+ * solves the rows, usually from the same state, and am_updatevars then
+ * republishes every value from the tableau.  Any change to the constraint
+ * set starts a new generation, which no older entry matches. */
+
+static void am_freememo(am_Solver *solver, am_Memo *memo)
+{
+    if (solver->memo_hit == memo)
+        solver->memo_hit = NULL;
+    if (memo->edits != NULL)
+        am_realloc(solver, memo->edits, 0,
+                   memo->edit_count * sizeof(am_VarValue));
+    if (memo->values != NULL)
+        am_realloc(solver, memo->values, 0,
+                   memo->value_count * sizeof(am_VarValue));
+    memset(memo, 0, sizeof(*memo));
+}
+
+static void am_memostore(am_Solver *solver)
+{
+    am_Memo *memo = &solver->memo[0];
+    am_VarEntry *ve = NULL;
+    size_t edits = 0, values = 0;
+    unsigned i;
+    for (i = 1; i < solver->memo_size && memo->last_used != 0; ++i)
+        if (solver->memo[i].last_used < memo->last_used)
+            memo = &solver->memo[i];
+    am_freememo(solver, memo);
+    while (am_nextentry(&solver->vars, (am_Entry **)&ve)) {
+        edits += ve->variable->constraint != NULL;
+        values += ve->variable->alias == NULL && !ve->variable->fixed;
+    }
+    if (edits != 0)
+        memo->edits = (am_VarValue *)am_realloc(solver, NULL,
+                edits * sizeof(am_VarValue), 0);
+    if (values != 0)
+        memo->values = (am_VarValue *)am_realloc(solver, NULL,
+                values * sizeof(am_VarValue), 0);
+    while (am_nextentry(&solver->vars, (am_Entry **)&ve)) {
+        am_Variable *var = ve->variable;
+        am_VarValue *vv;
+        if (var->constraint != NULL) {
+            vv = &memo->edits[memo->edit_count++];
+            vv->var = var, vv->value = var->edit_value;
+        }
+        if (var->alias == NULL && !var->fixed) {
+            vv = &memo->values[memo->value_count++];
+            vv->var = var, vv->value = am_rowvalue(solver, var);
+        }
+    }
+    memo->generation = solver->generation;
+    memo->last_used = ++solver->memo_clock;
+}
+
+static int am_memolookup(am_Solver *solver)
+{
+    unsigned i;
+    size_t k;
+    for (i = 0; i < solver->memo_size; ++i) {
+        am_Memo *memo = &solver->memo[i];
+        if (memo->last_used == 0 || memo->generation != solver->generation)
+            continue;
+        for (k = 0; k < memo->edit_count; ++k)
+            if (memo->edits[k].var->edit_value != memo->edits[k].value)
+                break;
+        if (k < memo->edit_count)
+            continue;
+        memo->last_used = ++solver->memo_clock;
+        solver->memo_pending = 1;
+        solver->memo_hit = memo;
+        ++solver->memo_hits;
+        return 1;
+    }
+    ++solver->memo_misses;
+    return 0;
+}
+
+/* A child solver has variables bound to variables of its parent, and
+ * follows them as edits.  The parent never sees the child's rows: it only
+ * marks the child stale when it publishes a new value for a variable the
+ * child follows, and the child suggests the new values when it updates its
+ * own variables next.  A child that nothing asks for stays unsolved, and
+ * one whose sources kept their values isn't solved at all. */
+
+static void am_unlinksource(am_Variable *var)
+{
+    am_Variable **link = &var->source->followers;
+    while (*link != var)
+        link = &(*link)->next_follower;
+    *link = var->next_follower;
+    if (--var->solver->bound_count == 0) {
+        am_Solver **child = &var->solver->parent->children;
+        while (*child != var->solver)
+            child = &(*child)->next_child;
+        *child = var->solver->next_child;
+        var->solver->parent = var->solver->next_child = NULL;
+    }
+    am_delvariable(var->source);
+    var->source = var->next_follower = NULL;
+}
+
+static void am_detachsolver(am_Solver *solver)
+{
+    am_VarEntry *ve = NULL;
+    while (solver->parent != NULL && am_nextentry(&solver->vars,
+                                                  (am_Entry **)&ve))
+        if (ve->variable->source != NULL)
+            am_unlinksource(ve->variable);
+    while (solver->children != NULL) {
+        am_Solver *child = solver->children;
+        while (am_nextentry(&child->vars, (am_Entry **)&ve))
+            ve->variable->source = ve->variable->next_follower = NULL;
+        solver->children = child->next_child;
+        child->parent = child->next_child = NULL;
+        child->bound_count = 0;
+    }
+}
+
+static void am_publishvalue(am_Variable *var, am_Float value)
+{
+    if (value != var->value) {
+        am_Variable *f;
+        for (f = var->followers; f != NULL; f = f->next_follower)
+            f->solver->stale = 1;
+    }
+    var->value = value;
+}
+
+static void am_publish(am_Solver *solver, am_Variable *var)
+{
+    am_publishvalue(var, am_rowvalue(solver, var));
+}
+
+static void am_pullsources(am_Solver *solver)
+{
+    unsigned auto_update = solver->auto_update, depth = 0;
+    am_Recorder *rec = solver->recorder;
+    am_VarEntry *ve = NULL;
+    solver->stale = 0, solver->auto_update = 0;
+    /* a replay has no source to pull from, so each pull is logged as a
+     * plain suggest of its own, even from inside another call */
+    if (rec != NULL)
+        depth = rec->depth, rec->depth = 0;
+    while (am_nextentry(&solver->vars, (am_Entry **)&ve)) {
+        am_Variable *var = ve->variable;
+        if (var->source == NULL || var->edit_value == am_value(var->source))
+            continue;
+        am_suggest(var, am_value(var->source));
+    }
+    if (rec != NULL)
+        rec->depth = depth;
+    solver->auto_update = auto_update;
+}
+
+static void *am_default_allocf(void *ud, void *ptr, size_t nsize, size_t osize)
+{
+    void *newptr;
+    (void)ud, (void)osize;
+    if (nsize == 0) {
+        free(ptr);
+        return NULL;
+    }
+    newptr = realloc(ptr, nsize);
+    if (newptr == NULL)
+        abort();
+    return newptr;
+}
+
+AM_API am_Solver *am_newsolver(am_Allocf *allocf, void *ud)
+{
+    am_Solver *solver;
+    if (allocf == NULL)
+        allocf = am_default_allocf;
+    if ((solver = (am_Solver *)allocf(ud, NULL, sizeof(am_Solver), 0)) == NULL)
         return NULL;
     memset(solver, 0, sizeof(*solver));
+    am_count(solver, bytes_allocated, sizeof(am_Solver));
+    solver->revision = 1; /* no edit has a cache built yet */
     solver->allocf = allocf;
     solver->ud = ud;
     am_initrow(&solver->objective);
     am_inittable(&solver->vars, sizeof(am_VarEntry));
     am_inittable(&solver->constraints, sizeof(am_ConsEntry));
     am_inittable(&solver->rows, sizeof(am_Row));
+    am_inittable(&solver->bounds, sizeof(am_VarEntry));
+    am_inittable(&solver->columns, sizeof(am_Column));
+    am_inittable(&solver->diffnodes, sizeof(am_DiffNode));
+    am_resetbudget(solver);
     am_initpool(&solver->varpool, sizeof(am_Variable));
     am_initpool(&solver->conspool, sizeof(am_Constraint));
     return solver;
 }
 
-AM_API void am_delsolver(am_Solver *solver)
+AM_API void am_delsolver(am_Solver *solver)
+{
+    am_ConsEntry *ce = NULL;
+    am_Row *row = NULL;
+    am_reclog(solver, AM_REC_DELSOLVER);
+    am_record(solver, NULL);
+    am_settrace(solver, NULL, NULL);
+    am_detachsolver(solver);
+    while (am_nextentry(&solver->constraints, (am_Entry **)&ce)) {
+        am_freerow(solver, &ce->constraint->expression);
+        am_freesense(solver, ce->constraint);
+    }
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        am_freerow(solver, row);
+    am_freerow(solver, &solver->objective);
+    if (solver->infeasible_heap != NULL)
+        am_realloc(solver, solver->infeasible_heap, 0,
+                   solver->infeasible_size * sizeof(am_Infeasible));
+    am_freecolumns(solver);
+    am_diffclear(solver);
+    if (solver->diff_heap != NULL)
+        am_realloc(solver, solver->diff_heap, 0,
+                   solver->heap_size * sizeof(am_DiffStep));
+    if (solver->diff_undo != NULL)
+        am_realloc(solver, solver->diff_undo, 0,
+                   solver->undo_size * sizeof(am_DiffStep));
+    am_memoize(solver, 0);
+    am_latency(solver, 0);
+    am_freetable(solver, &solver->vars);
+    am_freetable(solver, &solver->constraints);
+    am_freetable(solver, &solver->rows);
+    am_freetable(solver, &solver->bounds);
+    am_freepool(solver, &solver->varpool);
+    am_freepool(solver, &solver->conspool);
+    solver->allocf(solver->ud, solver, 0, sizeof(*solver));
+}
+
+static void am_resetsolver_impl(am_Solver *solver, int clear_constraints)
+{
+    am_Entry *entry = NULL;
+    am_settle(solver);
+    if (!solver->auto_update)
+        am_updatevars(solver);
+    while (am_nextentry(&solver->vars, &entry)) {
+        am_Variable *var = ((am_VarEntry *)entry)->variable;
+        if (var->source != NULL)
+            am_unlinksource(var);
+        am_remove(var->constraint);
+        var->constraint = NULL;
+    }
+    assert(am_nearzero(solver->objective.constant));
+    assert(!am_hasinfeasible(solver));
+    assert(am_Symbol_id(solver->dirty_vars) == 0);
+    if (!clear_constraints)
+        return;
+    am_resetrow(&solver->objective);
+    am_unlinkvars(solver);
+    am_resetvars(solver);
+    am_diffclear(solver);
+    while (am_nextentry(&solver->constraints, &entry)) {
+        am_Constraint *cons = ((am_ConsEntry *)entry)->constraint;
+        cons->marker = cons->other = am_null();
+        cons->presolved = am_null();
+        cons->disabled = cons->indiff = 0;
+    }
+    while (am_nextentry(&solver->rows, &entry)) {
+        am_delkey(&solver->rows, entry);
+        am_freerow(solver, (am_Row *)entry);
+    }
+    ++solver->revision;
+    am_freecolumns(solver);
+}
+
+static void am_updatevars_impl(am_Solver *solver)
+{
+    am_Memo *memo = solver->memo_hit;
+    solver->memo_hit = NULL;
+    if (am_hasinfeasible(solver)) {
+        size_t k;
+        for (k = 0; memo != NULL && k < memo->value_count; ++k)
+            am_publishvalue(memo->values[k].var, memo->values[k].value);
+        return;
+    }
+    if (solver->memo_pending) {
+        am_VarEntry *ve = NULL;
+        while (am_nextentry(&solver->vars, (am_Entry **)&ve))
+            am_publish(solver, ve->variable);
+        solver->memo_pending = 0;
+    }
+    while (am_Symbol_id(solver->dirty_vars) != 0) {
+        am_Variable *var = am_sym2var(solver, solver->dirty_vars);
+        solver->dirty_vars = var->dirty_next;
+        var->dirty_next = am_null();
+        am_publish(solver, var);
+    }
+}
+
+static int am_add_row(am_Solver *solver, am_Constraint *cons)
+{
+    int ret, oldsym = solver->symbol_count;
+    am_Row row;
+    if (am_freeze_cons(solver, cons, &ret))
+        return ret;
+    if (am_presolve_cons(solver, cons))
+        return AM_OK;
+    if (am_diff_cons(solver, cons, &ret))
+        return ret;
+    am_diffrelease(solver, NULL, cons);
+    row = am_makerow(solver, cons);
+    if ((ret = am_try_addrow(solver, &row, cons)) != AM_OK) {
+        am_remove_errors(solver, cons);
+        solver->symbol_count = oldsym;
+    }
+    return ret;
+}
+
+static void am_remove_row(am_Solver *solver, am_Constraint *cons)
+{
+    am_Symbol marker = cons->marker;
+    am_Row tmp;
+    am_remove_errors(solver, cons);
+    if (cons->indiff) {
+        am_diffremove(solver, cons);
+        return;
+    }
+    if (am_Symbol_id(cons->presolved) != 0) {
+        cons->presolved = am_null();
+        am_rebuild(solver); /* its alias is folded into other rows */
+        return;
+    }
+    if (am_getrow(solver, marker, &tmp) != AM_OK) {
+        am_Variable *upper;
+        am_Symbol exit = am_get_leaving_row(solver, marker, &upper);
+        if (am_Symbol_id(exit) == 0)
+            return; /* in no row, as left by am_add_with_artificial */
+        if (upper != NULL)
+            am_flip(solver, upper, NULL);
+        am_getrow(solver, exit, &tmp);
+        am_solvefor(solver, &tmp, marker, exit);
+        am_substitute_rows(solver, marker, &tmp);
+        am_markbound(solver, exit);
+    }
+    am_freerow(solver, &tmp);
+}
+
+static int am_add_impl(am_Constraint *cons)
+{
+    am_Solver *solver = cons ? cons->solver : NULL;
+    int ret;
+    if (solver == NULL || am_Symbol_id(cons->marker) != 0 || cons->disabled)
+        return AM_FAILED;
+    am_probe2(add_entry, solver, am_Symbol_id(am_key(cons)));
+    am_traceop(solver, AM_TRACE_BEGIN, AM_TRACE_ADD, cons, NULL, AM_OK);
+    am_settle(solver);
+    if ((ret = am_add_row(solver, cons)) == AM_OK)
+        ret = am_solve(solver);
+    am_probe3(add_return, solver, am_Symbol_id(am_key(cons)), ret);
+    return am_traceop(solver, AM_TRACE_END, AM_TRACE_ADD, cons, NULL, ret);
+}
+
+static int am_addgroup_impl(am_Constraint **cons, size_t count)
+{
+    am_Solver *solver = NULL;
+    am_Table seen;
+    int r, ret = AM_OK;
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        if (cons[i] == NULL || (solver && cons[i]->solver != solver) ||
+            am_Symbol_id(cons[i]->marker) != 0 || cons[i]->disabled) {
+            ret = AM_FAILED;
+            continue;
+        }
+        if (solver == NULL) {
+            am_settle(solver = cons[i]->solver);
+            am_initseen(solver, &seen);
+            solver->pivots_left = ~0u; /* the budget is for the final solve */
+        }
+        if ((r = am_bulk_addrow(solver, &seen, cons[i])) != AM_OK)
+            ret = r;
+    }
+    if (solver == NULL)
+        return ret;
+    am_freetable(solver, &seen);
+    am_resetbudget(solver);
+    if (am_solve(solver) == AM_INCOMPLETE && ret == AM_OK)
+        ret = AM_INCOMPLETE;
+    return ret;
+}
+
+static void am_remove_impl(am_Constraint *cons)
+{
+    am_Solver *solver;
+    int ret;
+    if (cons == NULL)
+        return;
+    if (am_Symbol_id(cons->marker) == 0) {
+        cons->disabled = 0;
+        return;
+    }
+    solver = cons->solver;
+    am_probe2(remove_entry, solver, am_Symbol_id(am_key(cons)));
+    am_traceop(solver, AM_TRACE_BEGIN, AM_TRACE_REMOVE, cons, NULL, AM_OK);
+    am_settle(solver);
+    am_remove_row(solver, cons);
+    ret = am_solve(solver);
+    am_probe3(remove_return, solver, am_Symbol_id(am_key(cons)), ret);
+    am_traceop(solver, AM_TRACE_END, AM_TRACE_REMOVE, cons, NULL, ret);
+}
+
+/* A disabled constraint keeps its symbols and rows in the tableau; its
+ * error variables just stop costing anything, so the optimizer is free to
+ * violate it.  Required constraints have no error variables to relax and
+ * are taken out of the tableau instead. */
+
+static int am_disable_cons(am_Solver *solver, am_Constraint *cons)
+{
+    if (cons->disabled)
+        return AM_OK;
+    if (am_Symbol_id(cons->marker) == 0)
+        return AM_FAILED;
+    if (cons->strength >= AM_REQUIRED)
+        am_remove_row(solver, cons);
+    else
+        am_reweight(solver, cons, -cons->strength);
+    cons->disabled = 1;
+    return AM_OK;
+}
+
+static int am_enable_cons(am_Solver *solver, am_Constraint *cons)
+{
+    int ret;
+    if (!cons->disabled)
+        return am_Symbol_id(cons->marker) != 0 ? AM_OK : AM_FAILED;
+    if (am_Symbol_id(cons->marker) != 0) {
+        cons->disabled = 0;
+        am_reweight(solver, cons, cons->strength);
+        return AM_OK;
+    }
+    if ((ret = am_add_row(solver, cons)) != AM_OK) {
+        cons->disabled = 1; /* stays disabled if it can't be satisfied */
+        return ret;
+    }
+    cons->disabled = 0;
+    return AM_OK;
+}
+
+static int am_disable_impl(am_Constraint *cons)
+{
+    am_Solver *solver = cons ? cons->solver : NULL;
+    int ret;
+    if (solver == NULL)
+        return AM_FAILED;
+    am_settle(solver);
+    if ((ret = am_disable_cons(solver, cons)) == AM_OK)
+        ret = am_solve(solver);
+    return ret;
+}
+
+static int am_enable_impl(am_Constraint *cons)
+{
+    am_Solver *solver = cons ? cons->solver : NULL;
+    int ret;
+    if (solver == NULL)
+        return AM_FAILED;
+    am_settle(solver);
+    ret = am_enable_cons(solver, cons);
+    if (am_solve(solver) == AM_INCOMPLETE && ret == AM_OK)
+        ret = AM_INCOMPLETE;
+    return ret;
+}
+
+static int am_disablegroup_impl(am_Constraint **cons, size_t count)
+{
+    am_Solver *solver = NULL;
+    int ret = AM_OK;
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        if (cons[i] == NULL || (solver && cons[i]->solver != solver)) {
+            ret = AM_FAILED;
+            continue;
+        }
+        if (solver == NULL)
+            am_settle(solver = cons[i]->solver);
+        if (am_disable_cons(solver, cons[i]) != AM_OK)
+            ret = AM_FAILED;
+    }
+    if (solver != NULL && am_solve(solver) == AM_INCOMPLETE && ret == AM_OK)
+        ret = AM_INCOMPLETE;
+    return ret;
+}
+
+static int am_enablegroup_impl(am_Constraint **cons, size_t count)
+{
+    am_Solver *solver = NULL;
+    int r, ret = AM_OK;
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        if (cons[i] == NULL || (solver && cons[i]->solver != solver)) {
+            ret = AM_FAILED;
+            continue;
+        }
+        if (solver == NULL)
+            am_settle(solver = cons[i]->solver);
+        if ((r = am_enable_cons(solver, cons[i])) != AM_OK)
+            ret = r;
+    }
+    if (solver != NULL && am_solve(solver) == AM_INCOMPLETE && ret == AM_OK)
+        ret = AM_INCOMPLETE;
+    return ret;
+}
+
+static int am_setstrength_impl(am_Constraint *cons, am_Float strength)
+{
+    if (cons == NULL)
+        return AM_FAILED;
+    strength = am_nearzero(strength) ? AM_REQUIRED : strength;
+    if (cons->strength == strength)
+        return AM_OK;
+    if (cons->strength >= AM_REQUIRED || strength >= AM_REQUIRED) {
+        int ret, disabled = cons->disabled;
+        am_remove(cons), cons->strength = strength;
+        if (!disabled)
+            return am_add(cons);
+        if (strength >= AM_REQUIRED)
+            return cons->disabled = 1, AM_OK;
+        if ((ret = am_add(cons)) == AM_OK)
+            ret = am_disable(cons);
+        return ret;
+    }
+    if (am_Symbol_id(cons->marker) != 0 && !cons->disabled) {
+        am_Solver *solver = cons->solver;
+        am_Float diff = strength - cons->strength;
+        cons->strength = strength;
+        am_settle(solver);
+        am_reweight(solver, cons, diff);
+        return am_solve(solver);
+    }
+    cons->strength = strength;
+    return AM_OK;
+}
+
+static int am_bindbounds(am_Solver *solver, am_Variable *var,
+                         am_Float lower, am_Float upper)
+{
+    int bounded = lower > -AM_FLOAT_MAX || upper < AM_FLOAT_MAX;
+    int rebuild = (var->intableau || var->indiff) &&
+                  (bounded || am_Symbol_id(var->bound));
+    if (bounded && am_Symbol_id(var->bound) == 0) {
+        var->bound = am_newsymbol(solver, AM_SLACK);
+        ((am_VarEntry *)am_settable(solver, &solver->bounds, var->bound))
+            ->variable = var;
+    }
+    else if (!bounded && am_Symbol_id(var->bound) != 0) {
+        am_delkey(&solver->bounds,
+                  (am_Entry *)am_gettable(&solver->bounds, var->bound));
+        var->bound = am_null();
+    }
+    var->lower = lower, var->upper = upper;
+    var->flipped = lower <= -AM_FLOAT_MAX;
+    am_markdirty(solver, var);
+    return rebuild; /* rows already hold the old meaning of the symbol */
+}
+
+static int am_addlimit(am_Variable *var, am_Float limit, int relation,
+                       am_Float strength, am_Constraint **pcons)
+{
+    am_Constraint *cons = am_newconstraint(var->solver, strength);
+    int ret;
+    am_addterm(cons, var, 1.0f);
+    am_setrelation(cons, relation);
+    am_addconstant(cons, limit);
+    if ((ret = am_add(cons)) != AM_OK && ret != AM_INCOMPLETE) {
+        am_delconstraint(cons);
+        return ret;
+    }
+    *pcons = cons;
+    return AM_OK;
+}
+
+static int am_setbounds_impl(am_Variable *var, am_Float lower, am_Float upper,
+                             am_Float strength)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Float oldlower, oldupper;
+    int i, native, ret = AM_OK;
+    if (var == NULL || lower > upper)
+        return AM_FAILED;
+    strength = am_nearzero(strength) ? AM_REQUIRED : strength;
+    native = strength >= AM_REQUIRED && var->alias == NULL && !var->fixed;
+    am_settle(solver);
+    for (i = 0; i < 2; ++i) {
+        am_delconstraint(var->limits[i]);
+        var->limits[i] = NULL;
+    }
+    oldlower = var->lower, oldupper = var->upper;
+    if (am_bindbounds(solver, var, native ? lower : -AM_FLOAT_MAX,
+                      native ? upper : AM_FLOAT_MAX) &&
+        (ret = am_rebuild(solver)) != AM_OK) {
+        am_bindbounds(solver, var, oldlower, oldupper);
+        am_rebuild(solver);
+    }
+    if (!native && lower > -AM_FLOAT_MAX)
+        ret = am_addlimit(var, lower, AM_GREATEQUAL, strength, &var->limits[0]);
+    if (!native && upper < AM_FLOAT_MAX && ret == AM_OK)
+        ret = am_addlimit(var, upper, AM_LESSEQUAL, strength, &var->limits[1]);
+    i = am_solve(solver);
+    return ret != AM_OK ? ret : i;
+}
+
+static int am_addedit_impl(am_Variable *var, am_Float strength)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Constraint *cons;
+    int ret;
+    if (var == NULL)
+        return AM_FAILED;
+    assert(am_Symbol_id(var->sym) != 0);
+    if (strength >= AM_STRONG)
+        strength = AM_STRONG;
+    if (var->constraint != NULL) {
+        if (!var->constraint->disabled)
+            return AM_FAILED;
+        am_setstrength(var->constraint, strength);
+        return am_resumeedit(var);
+    }
+    cons = am_newconstraint(solver, strength);
+    am_setrelation(cons, AM_EQUAL);
+    am_addterm(cons, var, 1.0f); /* var must have positive signture */
+    am_addconstant(cons, -am_value(var));
+    ret = am_add(cons);
+    assert(ret == AM_OK || ret == AM_INCOMPLETE);
+    var->constraint = cons;
+    var->edit_value = am_value(var);
+    return ret;
+}
+
+static void am_deledit_impl(am_Variable *var)
+{
+    if (var == NULL || var->constraint == NULL)
+        return;
+    if (var->source != NULL)
+        am_unlinksource(var);
+    am_delconstraint(var->constraint);
+    var->constraint = NULL;
+    var->edit_value = 0.0f;
+}
+
+AM_API int am_bind(am_Variable *var, am_Variable *source, am_Float strength)
+{
+    am_Solver *solver = var ? var->solver : NULL, *up;
+    int ret;
+    if (solver == NULL || source == NULL || var->constraint != NULL ||
+        (solver->parent != NULL && solver->parent != source->solver))
+        return AM_FAILED;
+    for (up = source->solver; up != NULL; up = up->parent)
+        if (up == solver)
+            return AM_FAILED;
+    if ((ret = am_addedit(var, strength)) != AM_OK && ret != AM_INCOMPLETE)
+        return ret;
+    am_usevariable(source);
+    var->source = source;
+    var->next_follower = source->followers, source->followers = var;
+    if (solver->bound_count++ == 0) {
+        solver->parent = source->solver;
+        solver->next_child = source->solver->children;
+        source->solver->children = solver;
+    }
+    solver->stale = 1;
+    if (source->alias != NULL) {
+        /* an alias changes value without being published */
+        am_settle(source->solver);
+        am_rebuild(source->solver);
+        am_solve(source->solver);
+    }
+    return ret;
+}
+
+AM_API void am_unbind(am_Variable *var)
+{
+    if (var != NULL && var->source != NULL)
+        am_deledit(var);
+}
+
+/* A suspended edit stays in the tableau with no weight.  Suspending and
+ * resuming only reweight its error columns in the objective and leave its
+ * rows alone, so the only pivots paid are the layout relaxing once the
+ * edit lets go. */
+
+static int am_suspendedit_impl(am_Variable *var)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Constraint *cons = var ? var->constraint : NULL;
+    if (cons == NULL)
+        return AM_FAILED;
+    if (cons->disabled)
+        return AM_OK;
+    am_settle(solver);
+    am_reweight(solver, cons, -cons->strength);
+    cons->disabled = 1;
+    return am_solve(solver);
+}
+
+static int am_resumeedit_impl(am_Variable *var)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Constraint *cons = var ? var->constraint : NULL;
+    am_Float value;
+    if (cons == NULL)
+        return AM_FAILED;
+    if (!cons->disabled)
+        return AM_OK;
+    am_settle(solver);
+    value = am_tablevalue(solver, var);
+    if (!am_approx(value, var->edit_value)) {
+        /* the layout moved meanwhile, restart from where the variable is */
+        am_delta_edit_constant(solver, value - var->edit_value, cons);
+        var->edit_value = value;
+        am_settle(solver);
+    }
+    am_reweight(solver, cons, cons->strength);
+    cons->disabled = 0;
+    return am_solve(solver);
+}
+
+static int am_suggest_impl(am_Variable *var, am_Float value)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Float delta;
+    int ret;
+    if (var == NULL)
+        return AM_FAILED;
+    am_probe2(suggest_entry, solver, am_Symbol_id(var->sym));
+    am_traceop(solver, AM_TRACE_BEGIN, AM_TRACE_SUGGEST, NULL, var, AM_OK);
+    if (var->constraint == NULL) {
+        am_addedit(var, AM_MEDIUM);
+        assert(var->constraint != NULL);
+    }
+    else if (var->constraint->disabled)
+        am_resumeedit(var);
+    if (solver->incomplete)
+        am_settle(solver); /* the dual phase needs an optimal tableau */
+    else {
+        am_checkrefactor(solver);
+        am_resetbudget(solver);
+    }
+    delta = value - var->edit_value;
+    var->edit_value = value;
+    am_delta_edit_constant(solver, delta, var->constraint);
+    if (solver->memo_size != 0 && am_hasinfeasible(solver)) {
+        unsigned revision = solver->revision;
+        if (am_memolookup(solver)) {
+            if (solver->auto_update)
+                am_updatevars(solver);
+            am_probe3(suggest_return, solver, am_Symbol_id(var->sym), AM_OK);
+            return am_traceop(solver, AM_TRACE_END, AM_TRACE_SUGGEST, NULL,
+                              var, AM_OK);
+        }
+        if ((ret = am_dual_optimize(solver)) == AM_OK &&
+            solver->revision != revision)
+            am_memostore(solver);
+    }
+    else
+        ret = am_dual_optimize(solver);
+    if (solver->auto_update)
+        am_updatevars(solver);
+    am_probe3(suggest_return, solver, am_Symbol_id(var->sym), ret);
+    return am_traceop(solver, AM_TRACE_END, AM_TRACE_SUGGEST, NULL, var, ret);
+}
+
+/* A sweep moves the edit value through [from, to] the way the dual phase
+ * would, but one breakpoint at a time: between breakpoints the basis is
+ * fixed, so every basic value is linear in the edit value, and crossing a
+ * breakpoint takes a single pivot on the row that would turn infeasible. */
+
+static am_Row *am_sweeplimit(am_Solver *solver, am_Row *row, am_Float rate,
+                             am_Float *step, am_Row *blocking)
+{
+    am_Variable *var;
+    am_Float span, limit;
+    if (am_isexternal(am_key(row)) || am_nearzero(rate))
+        return blocking;
+    if (rate < 0.0f)
+        limit = row->constant / -rate;
+    else if ((var = am_boundvar(solver, am_key(row))) != NULL
+            && (span = am_span(var)) < AM_FLOAT_MAX)
+        limit = (span - row->constant) / rate;
+    else
+        return blocking;
+    if (limit < *step)
+        *step = limit, blocking = row;
+    return blocking;
+}
+
+static am_Row *am_nextbreak(am_Solver *solver, am_Constraint *cons,
+                            am_Float sign, am_Float *step)
+{
+    /* the rates are the ones am_delta_edit_constant applies */
+    am_Row *row, *blocking = NULL;
+    unsigned i;
+    if ((row = (am_Row *)am_gettable(&solver->rows, cons->marker)) != NULL)
+        return am_sweeplimit(solver, row, -sign, step, NULL);
+    if ((row = (am_Row *)am_gettable(&solver->rows, cons->other)) != NULL)
+        return am_sweeplimit(solver, row, sign, step, NULL);
+    if (cons->sense_revision != solver->revision)
+        am_buildsense(solver, cons);
+    for (i = 0; i < cons->sense_count; ++i)
+        blocking = am_sweeplimit(solver, cons->sense[i].row,
+                                 cons->sense[i].multiplier * sign, step,
+                                 blocking);
+    return blocking;
+}
+
+static void am_crossbreak(am_Solver *solver, am_Row *row)
+{
+    am_Variable *var = am_boundvar(solver, am_key(row));
+    if (var != NULL && !am_nearzero(row->constant))
+        am_flip(solver, var, NULL); /* reached its upper bound */
+    row->constant = 0.0f;
+    am_dual_pivot(solver, row);
+}
+
+static int am_sweep_impl(am_Variable *var, am_Float from, am_Float to,
+                         am_Variable **vars, size_t count, am_Sweepf *f,
+                         void *ud)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Float sign = to < from ? -1.0f : 1.0f, *values = NULL;
+    size_t i, pieces = 0, size = 2 * count * sizeof(am_Float);
+    int ret;
+    if (var == NULL || f == NULL || (count != 0 && vars == NULL))
+        return AM_FAILED;
+    if ((ret = am_suggest_impl(var, from)) != AM_OK ||
+            (ret = am_dual_optimize(solver)) != AM_OK) /* after a memo hit */
+        return ret;
+    if (count != 0)
+        values = (am_Float *)am_realloc(solver, NULL, size, 0);
+    for (;;) {
+        am_Float start = var->edit_value, end, step = (to - start) * sign;
+        am_Row *row = am_nextbreak(solver, var->constraint, sign, &step);
+        end = row ? start + step * sign : to;
+        for (i = 0; i < count; ++i)
+            values[i] = am_tablevalue(solver, vars[i]), values[count + i] = 0;
+        if (end != start || (row == NULL && pieces == 0)) {
+            am_delta_edit_constant(solver, end - start, var->constraint);
+            var->edit_value = end;
+            for (i = 0; end != start && i < count; ++i)
+                values[count + i] = (am_tablevalue(solver, vars[i])
+                                     - values[i]) / (end - start);
+            f(ud, start, end, values, values ? values + count : NULL);
+            ++pieces;
+        }
+        if (row == NULL)
+            break;
+        if (!am_usepivot(solver)) {
+            ret = AM_INCOMPLETE; /* the edit stays at this breakpoint */
+            break;
+        }
+        am_crossbreak(solver, row);
+        if ((ret = am_dual_optimize(solver)) != AM_OK)
+            break;
+    }
+    if (values != NULL)
+        am_realloc(solver, values, 0, size);
+    if (solver->auto_update)
+        am_updatevars(solver);
+    return ret;
+}
+
+static void am_presolve_impl(am_Solver *solver, int enable)
+{
+    if (solver->presolve && !enable) {
+        solver->presolve = 0;
+        am_settle(solver);
+        am_rebuild(solver);
+        am_solve(solver);
+    }
+    solver->presolve = enable;
+}
+
+static int am_setfrozen(am_Variable **vars, size_t count, int frozen)
+{
+    am_Solver *solver = NULL;
+    size_t i;
+    int ret;
+    for (i = 0; i < count; ++i) {
+        if (vars[i] == NULL || (solver && vars[i]->solver != solver))
+            return AM_FAILED;
+        solver = vars[i]->solver;
+    }
+    if (solver == NULL)
+        return AM_OK;
+    am_settle(solver);
+    am_updatevars(solver);
+    for (i = 0; i < count; ++i) {
+        am_Variable *var = vars[i];
+        if (!var->frozen == !frozen)
+            continue;
+        if (frozen)
+            var->offset = am_value(var), ++solver->frozen_count;
+        else
+            --solver->frozen_count;
+        var->frozen = frozen;
+    }
+    ret = am_rebuild(solver);
+    if (solver->auto_update)
+        am_updatevars(solver);
+    return ret;
+}
+
+static int am_freeze_impl(am_Variable **vars, size_t count)
+{
+    return am_setfrozen(vars, count, 1);
+}
+
+static int am_thaw_impl(am_Variable **vars, size_t count)
+{
+    return am_setfrozen(vars, count, 0);
+}
+
+AM_API void am_memoize(am_Solver *solver, unsigned states)
+{
+    am_Recorder *rec = am_reclog(solver, AM_REC_MEMOIZE);
+    unsigned i;
+    if (rec != NULL)
+        am_recuint(rec, states);
+    for (i = 0; i < solver->memo_size; ++i)
+        am_freememo(solver, &solver->memo[i]);
+    if (solver->memo != NULL)
+        am_realloc(solver, solver->memo, 0,
+                   solver->memo_size * sizeof(am_Memo));
+    solver->memo = NULL;
+    solver->memo_size = states;
+    if (states == 0)
+        return;
+    solver->memo = (am_Memo *)am_realloc(solver, NULL,
+            states * sizeof(am_Memo), 0);
+    memset(solver->memo, 0, states * sizeof(am_Memo));
+}
+
+AM_API void am_memostats(am_Solver *solver, size_t *hits, size_t *misses)
+{
+    if (hits)
+        *hits = solver->memo_hits;
+    if (misses)
+        *misses = solver->memo_misses;
+}
+
+static void am_diffsolve_impl(am_Solver *solver, int enable)
+{
+    if (solver->diffsolve && !enable) {
+        solver->diffsolve = 0;
+        am_settle(solver);
+        am_rebuild(solver);
+        am_solve(solver);
+    }
+    solver->diffsolve = enable;
+}
+
+AM_API int am_getstats(am_Solver *solver, am_Stats *stats)
+{
+    am_Row *row = NULL;
+    if (solver == NULL || stats == NULL)
+        return AM_FAILED;
+#ifdef AM_USE_STATS
+    *stats = solver->stats;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+    stats->rows = solver->rows.count;
+    stats->nonzeros = 0;
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        stats->nonzeros += row->terms.count;
+    stats->objective_terms = solver->objective.terms.count;
+#ifdef AM_USE_STATS
+    return AM_OK;
+#else
+    return AM_FAILED; /* only the tableau sizes are known */
+#endif
+}
+
+AM_API void am_resetstats(am_Solver *solver)
+{
+#ifdef AM_USE_STATS
+    size_t bytes = solver->stats.bytes_allocated;
+    memset(&solver->stats, 0, sizeof(solver->stats));
+    solver->stats.bytes_allocated = bytes;
+#else
+    (void)solver;
+#endif
+}
+
+/* The health report only reads the tableau.  Columns are counted by
+ * sorting the symbols of every term, in a buffer taken straight from
+ * allocf so that the stats don't see it. */
+
+static unsigned am_lengthbucket(size_t n)
+{
+    unsigned b = 1;
+    if (n == 0)
+        return 0;
+    while (n > 1 && b < AM_HEALTH_BUCKETS - 1)
+        n >>= 1, ++b;
+    return b;
+}
+
+static int am_cmpid(const void *lhs, const void *rhs)
+{
+    unsigned a = *(const unsigned *)lhs, b = *(const unsigned *)rhs;
+    return a < b ? -1 : a > b;
+}
+
+static void am_healthterms(am_Health *health, const am_Row *row)
+{
+    am_Term *term = NULL;
+    while (am_nextentry(&row->terms, (am_Entry **)&term)) {
+        am_Float m = term->multiplier < 0 ? -term->multiplier
+                                          : term->multiplier;
+        if (health->min_coefficient < 0 || m < health->min_coefficient)
+            health->min_coefficient = m;
+        if (m > health->max_coefficient)
+            health->max_coefficient = m;
+        if (m < AM_FLOAT_EPS * 1000)
+            ++health->near_epsilon;
+    }
+}
+
+AM_API int am_gethealth(am_Solver *solver, am_Health *health)
+{
+    am_Row *row = NULL;
+    am_Term *term;
+    unsigned *ids = NULL;
+    size_t i, n = 0, run;
+    if (solver == NULL || health == NULL)
+        return AM_FAILED;
+    memset(health, 0, sizeof(*health));
+    health->min_coefficient = -1; /* until a term is seen */
+    health->objective_terms = solver->objective.terms.count;
+    am_healthterms(health, &solver->objective);
+    while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
+        size_t len = row->terms.count;
+        am_healthterms(health, row);
+        ++health->rows;
+        health->nonzeros += len;
+        ++health->row_lengths[am_lengthbucket(len)];
+        ++health->basic[am_Symbol_type(am_key(row))];
+        if (len > health->max_row_length)
+            health->max_row_length = len;
+    }
+    if (health->min_coefficient < 0)
+        health->min_coefficient = 0;
+    if (health->nonzeros == 0)
+        return AM_OK;
+
+    ids = (unsigned *)solver->allocf(solver->ud, NULL,
+                                     health->nonzeros * sizeof(unsigned), 0);
+    if (ids == NULL)
+        return AM_FAILED;
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        for (term = NULL; am_nextentry(&row->terms, (am_Entry **)&term);)
+            ids[n++] = am_Symbol_id(am_key(term));
+    qsort(ids, n, sizeof(unsigned), am_cmpid);
+    for (i = 0; i < n; i += run) {
+        for (run = 1; i + run < n && ids[i + run] == ids[i]; ++run)
+            ;
+        ++health->columns;
+        ++health->column_counts[am_lengthbucket(run)];
+        if (run > health->max_column_count)
+            health->max_column_count = run;
+    }
+    solver->allocf(solver->ud, ids, 0, health->nonzeros * sizeof(unsigned));
+    return AM_OK;
+}
+
+/* A monotonic clock in ns, for the latency histograms and the trace sink */
+
+static size_t am_nanotime(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (size_t)(now.QuadPart / freq.QuadPart * 1000000000 +
+                    now.QuadPart % freq.QuadPart * 1000000000 /
+                        freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_t)ts.tv_sec * 1000000000u + (size_t)ts.tv_nsec;
+#else
+    return (size_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+/* Latency histograms time the outermost public call with a monotonic
+ * clock, recording into fixed buckets so that nothing is allocated while
+ * the solver runs. */
+
+#ifdef AM_USE_STATS
+static int am_latop(int op)
+{
+    switch (op) {
+    case AM_REC_ADD: return AM_LAT_ADD;
+    case AM_REC_REMOVE: return AM_LAT_REMOVE;
+    case AM_REC_SUGGEST: return AM_LAT_SUGGEST;
+    case AM_REC_UPDATEVARS: return AM_LAT_UPDATEVARS;
+    case AM_REC_SETSTRENGTH: return AM_LAT_SETSTRENGTH;
+    }
+    return -1;
+}
+
+static unsigned am_latbucket(size_t ns)
+{
+    /* bucket AM_LAT_SUB * e + top holds top << e, top in [SUB, 2 SUB) */
+    unsigned e = 0;
+    while (ns >= 2 * AM_LAT_SUB)
+        ns >>= 1, ++e;
+    e = AM_LAT_SUB * e + (unsigned)ns;
+    return e < AM_LAT_BUCKETS ? e : AM_LAT_BUCKETS - 1;
+}
+
+static double am_latvalue(const am_Histogram *h, size_t rank)
+{
+    size_t seen = 0, lower, width;
+    unsigned i, e;
+    for (i = 0; i < AM_LAT_BUCKETS; ++i)
+        if ((seen += h->buckets[i]) >= rank)
+            break;
+    e = i < 2 * AM_LAT_SUB ? 0 : i / AM_LAT_SUB - 1;
+    lower = (size_t)(i - AM_LAT_SUB * e) << e;
+    width = (size_t)1 << e;
+    if (lower + width / 2 > h->max)
+        return (double)h->max / 1e3;
+    return (double)(lower + width / 2) / 1e3;
+}
+
+static void am_timebegin(am_Solver *solver, int op)
+{
+    am_Timing *t = solver ? solver->timing : NULL;
+    if (t == NULL || t->depth++ != 0)
+        return;
+    t->op = am_latop(op);
+    if (t->op >= 0)
+        t->start = am_nanotime();
+}
+
+static void am_timeend(am_Solver *solver)
+{
+    am_Timing *t = solver ? solver->timing : NULL;
+    am_Histogram *h;
+    size_t ns;
+    if (t == NULL || t->depth == 0 || --t->depth != 0 || t->op < 0)
+        return;
+    ns = am_nanotime() - t->start;
+    h = &t->ops[t->op];
+    ++h->count;
+    ++h->buckets[am_latbucket(ns)];
+    if (ns > h->max)
+        h->max = ns;
+}
+#else
+#define am_timebegin(solver, op) ((void)0)
+#define am_timeend(solver) ((void)0)
+#endif
+
+AM_API int am_latency(am_Solver *solver, int enable)
+{
+#ifdef AM_USE_STATS
+    if (solver == NULL)
+        return AM_FAILED;
+    if (!enable && solver->timing != NULL) {
+        am_realloc(solver, solver->timing, 0, sizeof(am_Timing));
+        solver->timing = NULL;
+    }
+    else if (enable && solver->timing == NULL) {
+        solver->timing = (am_Timing *)am_realloc(solver, NULL,
+                                                 sizeof(am_Timing), 0);
+        memset(solver->timing, 0, sizeof(am_Timing));
+    }
+    return AM_OK;
+#else
+    (void)solver, (void)enable;
+    return AM_FAILED;
+#endif
+}
+
+AM_API int am_getlatency(am_Solver *solver, int op, am_Latency *latency)
+{
+#ifdef AM_USE_STATS
+    const am_Histogram *h;
+#endif
+    if (latency == NULL)
+        return AM_FAILED;
+    memset(latency, 0, sizeof(*latency));
+#ifdef AM_USE_STATS
+    if (solver == NULL || solver->timing == NULL || op < 0 ||
+        op >= AM_LAT_OPS)
+        return AM_FAILED;
+    h = &solver->timing->ops[op];
+    latency->count = h->count;
+    if (h->count == 0)
+        return AM_OK;
+    latency->p50 = am_latvalue(h, (h->count + 1) / 2);
+    latency->p99 = am_latvalue(h, h->count - h->count / 100);
+    latency->p999 = am_latvalue(h, h->count - h->count / 1000);
+    latency->max = (double)h->max / 1e3;
+    return AM_OK;
+#else
+    (void)solver, (void)op;
+    return AM_FAILED;
+#endif
+}
+
+AM_API void am_resetlatency(am_Solver *solver)
+{
+#ifdef AM_USE_STATS
+    if (solver != NULL && solver->timing != NULL)
+        memset(solver->timing->ops, 0, sizeof(solver->timing->ops));
+#else
+    (void)solver;
+#endif
+}
+
+/* The Chrome sink writes the JSON array form of the trace event format,
+ * one event a line, which chrome://tracing and Perfetto open as is.
+ * Timestamps are microseconds of the monotonic clock since the file
+ * opened.  Calls are B/E pairs; a pivot is only reported as it starts, so
+ * it is held back and written as a complete event lasting until whatever
+ * is reported next. */
+
+static void am_traceline(am_TraceFile *tf, size_t ts)
+{
+    fprintf(tf->fp, "%s{\"pid\":1,\"tid\":1,\"ts\":%.3f,",
+            tf->events++ ? ",\n" : "", (double)ts / 1000.0);
+}
+
+static void am_flushpivot(am_TraceFile *tf, size_t now)
+{
+    static const char *const phases[] = {"", "primal", "dual", "artificial"};
+    const am_TraceEvent *ev = &tf->pivot;
+    if (!tf->pending)
+        return;
+    tf->pending = 0;
+    am_traceline(tf, tf->pivot_start);
+    fprintf(tf->fp, "\"dur\":%.3f,\"name\":\"pivot\",\"cat\":\"%s\","
+            "\"ph\":\"X\",\"args\":{\"entering\":%u,\"leaving\":%u,"
+            "\"row_terms\":%lu,\"rows\":%lu,\"ratio\":%g}}",
+            (double)(now - tf->pivot_start) / 1000.0, phases[ev->what],
+            ev->entering, ev->leaving, (unsigned long)ev->row_terms,
+            (unsigned long)ev->rows, (double)ev->ratio);
+}
+
+static void am_chrometrace(void *ud, const am_TraceEvent *ev)
+{
+    static const char *const ops[] = {"", "am_add", "am_remove", "am_suggest"};
+    am_TraceFile *tf = (am_TraceFile *)ud;
+    size_t now = am_nanotime() - tf->start;
+    am_flushpivot(tf, now);
+    if (ev->kind == AM_TRACE_PIVOT) {
+        tf->pivot = *ev, tf->pivot_start = now, tf->pending = 1;
+        return;
+    }
+    am_traceline(tf, now);
+    if (ev->kind == AM_TRACE_BEGIN)
+        fprintf(tf->fp, "\"name\":\"%s\",\"ph\":\"B\",\"args\":{\"%s\":%d,"
+                "\"rows\":%lu}}", ops[ev->what],
+                ev->constraint ? "constraint" : "variable",
+                ev->constraint ? (int)am_Symbol_id(am_key(ev->constraint))
+                               : am_variableid(ev->variable),
+                (unsigned long)ev->rows);
+    else
+        fprintf(tf->fp, "\"name\":\"%s\",\"ph\":\"E\",\"args\":{"
+                "\"result\":%d,\"rows\":%lu}}", ops[ev->what], ev->result,
+                (unsigned long)ev->rows);
+}
+
+static void am_closetrace(am_Solver *solver)
+{
+    am_TraceFile *tf = solver->tracefile;
+    if (tf == NULL)
+        return;
+    am_flushpivot(tf, am_nanotime() - tf->start);
+    fputs("\n]\n", tf->fp);
+    fclose(tf->fp);
+    am_realloc(solver, tf, 0, sizeof(am_TraceFile));
+    solver->tracefile = NULL;
+}
+
+AM_API void am_settrace(am_Solver *solver, am_Tracef *f, void *ud)
+{
+    if (solver == NULL)
+        return;
+    am_closetrace(solver);
+    solver->tracef = f;
+    solver->trace_ud = ud;
+}
+
+AM_API int am_tracefile(am_Solver *solver, const char *path)
+{
+    am_TraceFile *tf;
+    FILE *fp;
+    if (solver == NULL)
+        return AM_FAILED;
+    am_settrace(solver, NULL, NULL);
+    if (path == NULL)
+        return AM_OK;
+    if ((fp = fopen(path, "w")) == NULL)
+        return AM_FAILED;
+    tf = (am_TraceFile *)am_realloc(solver, NULL, sizeof(am_TraceFile), 0);
+    tf->fp = fp;
+    tf->start = am_nanotime();
+    tf->events = 0;
+    tf->pending = 0;
+    fputs("[\n", fp);
+    solver->tracef = am_chrometrace;
+    solver->trace_ud = tf;
+    solver->tracefile = tf;
+    return AM_OK;
+}
+
+AM_API void am_columnindex(am_Solver *solver, int enable)
+{
+    am_Recorder *rec = am_reclog(solver, AM_REC_COLUMNINDEX);
+    am_Row *row = NULL;
+    if (rec != NULL)
+        am_recuint(rec, enable != 0);
+    if (!solver->indexed == !enable)
+        return;
+    solver->indexed = 0;
+    am_freecolumns(solver);
+    if (!enable)
+        return;
+    solver->indexed = 1;
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        am_linkrow(solver, row, 1);
+}
+
+static int am_refactor_impl(am_Solver *solver)
+{
+    int ret;
+    if (solver == NULL)
+        return AM_FAILED;
+    am_settle(solver);
+    ret = am_refactor_solver(solver);
+    am_resetbudget(solver);
+    if (solver->auto_update)
+        am_updatevars(solver);
+    return ret;
+}
+
+AM_API void am_autorefactor(am_Solver *solver, unsigned pivots)
+{
+    am_Recorder *rec = am_reclog(solver, AM_REC_AUTOREFACTOR);
+    if (rec != NULL)
+        am_recuint(rec, pivots);
+    solver->refactor_interval = pivots;
+}
+
+AM_API void am_setbudget(am_Solver *solver, unsigned max_pivots)
+{
+    am_Recorder *rec = am_reclog(solver, AM_REC_SETBUDGET);
+    if (rec != NULL)
+        am_recuint(rec, max_pivots);
+    solver->budget = max_pivots;
+    am_resetbudget(solver);
+}
+
+static int am_resume_impl(am_Solver *solver)
+{
+    int ret;
+    if (solver == NULL)
+        return AM_FAILED;
+    am_resetbudget(solver);
+    if ((ret = am_dual_optimize(solver)) == AM_OK && solver->incomplete)
+        return am_solve(solver);
+    if (solver->auto_update)
+        am_updatevars(solver);
+    return ret;
+}
+
+/* The public calls that make other public calls are recorded and timed
+ * here, around their implementations, so that only the outermost one is
+ * logged and measured. */
+
+static am_Recorder *am_recbegin(am_Solver *solver, int op)
+{
+    am_Recorder *rec = am_reclog(solver, op);
+    if (solver != NULL && solver->recorder != NULL)
+        ++solver->recorder->depth;
+    am_timebegin(solver, op);
+    return rec;
+}
+
+static void am_recend(am_Solver *solver)
+{
+    am_timeend(solver);
+    if (solver != NULL && solver->recorder != NULL &&
+        solver->recorder->depth != 0)
+        --solver->recorder->depth;
+}
+
+static am_Recorder *am_recgroup(am_Solver *solver, int op, size_t count)
+{
+    am_Recorder *rec = am_recbegin(solver, op);
+    if (rec != NULL)
+        am_recuint(rec, count);
+    return rec;
+}
+
+static am_Solver *am_conssolver(am_Constraint **cons, size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; ++i)
+        if (cons[i] != NULL)
+            return cons[i]->solver;
+    return NULL;
+}
+
+static am_Solver *am_varsolver(am_Variable **vars, size_t count)
+{
+    size_t i;
+    for (i = 0; vars != NULL && i < count; ++i)
+        if (vars[i] != NULL)
+            return vars[i]->solver;
+    return NULL;
+}
+
+AM_API void am_resetsolver(am_Solver *solver, int clear_constraints)
+{
+    am_Recorder *rec = am_recbegin(solver, AM_REC_RESETSOLVER);
+    if (rec != NULL)
+        am_recuint(rec, clear_constraints != 0);
+    am_resetsolver_impl(solver, clear_constraints);
+    am_recend(solver);
+}
+
+AM_API void am_updatevars(am_Solver *solver)
+{
+    if (solver->parent != NULL) {
+        /* before the call is logged, so that a replay publishes what the
+         * pulls suggest */
+        am_updatevars(solver->parent);
+        if (solver->stale)
+            am_pullsources(solver);
+    }
+    am_recbegin(solver, AM_REC_UPDATEVARS);
+    am_updatevars_impl(solver);
+    am_recend(solver);
+}
+
+AM_API void am_presolve(am_Solver *solver, int enable)
+{
+    am_Recorder *rec = am_recbegin(solver, AM_REC_PRESOLVE);
+    if (rec != NULL)
+        am_recuint(rec, enable != 0);
+    am_presolve_impl(solver, enable);
+    am_recend(solver);
+}
+
+AM_API void am_diffsolve(am_Solver *solver, int enable)
+{
+    am_Recorder *rec = am_recbegin(solver, AM_REC_DIFFSOLVE);
+    if (rec != NULL)
+        am_recuint(rec, enable != 0);
+    am_diffsolve_impl(solver, enable);
+    am_recend(solver);
+}
+
+AM_API int am_refactor(am_Solver *solver)
+{
+    int ret;
+    am_recbegin(solver, AM_REC_REFACTOR);
+    ret = am_refactor_impl(solver);
+    am_recend(solver);
+    return ret;
+}
+
+AM_API int am_incomplete(am_Solver *solver)
+{
+    /* rows a memo hit left behind don't count, the budget is untouched */
+    if (solver == NULL)
+        return 0;
+    return solver->incomplete || (solver->pivots_left == 0 &&
+                                  am_hasinfeasible(solver));
+}
+
+AM_API int am_resume(am_Solver *solver)
+{
+    int ret;
+    am_recbegin(solver, AM_REC_RESUME);
+    ret = am_resume_impl(solver);
+    am_recend(solver);
+    return ret;
+}
+
+static int am_reccall(am_Constraint *cons, int op, int (*f)(am_Constraint *))
+{
+    am_Solver *solver = cons ? cons->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, op);
+    int ret;
+    if (rec != NULL)
+        am_reccons(rec, cons);
+    ret = f(cons);
+    am_recend(solver);
+    return ret;
+}
+
+AM_API int am_add(am_Constraint *cons)
+{
+    return am_reccall(cons, AM_REC_ADD, am_add_impl);
+}
+
+AM_API int am_disable(am_Constraint *cons)
+{
+    return am_reccall(cons, AM_REC_DISABLE, am_disable_impl);
+}
+
+AM_API int am_enable(am_Constraint *cons)
+{
+    return am_reccall(cons, AM_REC_ENABLE, am_enable_impl);
+}
+
+AM_API void am_remove(am_Constraint *cons)
 {
-    am_ConsEntry *ce = NULL;
-    am_Row *row = NULL;
-    while (am_nextentry(&solver->constraints, (am_Entry **)&ce))
-        am_freerow(solver, &ce->constraint->expression);
-    while (am_nextentry(&solver->rows, (am_Entry **)&row))
-        am_freerow(solver, row);
-    am_freerow(solver, &solver->objective);
-    am_freetable(solver, &solver->vars);
-    am_freetable(solver, &solver->constraints);
-    am_freetable(solver, &solver->rows);
-    am_freepool(solver, &solver->varpool);
-    am_freepool(solver, &solver->conspool);
-    solver->allocf(solver->ud, solver, 0, sizeof(*solver));
+    am_Solver *solver = cons ? cons->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_REMOVE);
+    if (rec != NULL)
+        am_reccons(rec, cons);
+    am_remove_impl(cons);
+    am_recend(solver);
 }
 
-AM_API void am_resetsolver(am_Solver *solver, int clear_constraints)
+AM_API void am_resetconstraint(am_Constraint *cons)
 {
-    am_Entry *entry = NULL;
-    if (!solver->auto_update)
-        am_updatevars(solver);
-    while (am_nextentry(&solver->vars, &entry)) {
-        am_Constraint **cons = &((am_VarEntry *)entry)->variable->constraint;
-        am_remove(*cons);
-        *cons = NULL;
-    }
-    assert(am_nearzero(solver->objective.constant));
-    assert(am_Symbol_id(solver->infeasible_rows) == 0);
-    assert(am_Symbol_id(solver->dirty_vars) == 0);
-    if (!clear_constraints)
-        return;
-    am_resetrow(&solver->objective);
-    while (am_nextentry(&solver->constraints, &entry)) {
-        am_Constraint *cons = ((am_ConsEntry *)entry)->constraint;
-        if (am_Symbol_id(cons->marker) == 0)
-            continue;
-        cons->marker = cons->other = am_null();
-    }
-    while (am_nextentry(&solver->rows, &entry)) {
-        am_delkey(&solver->rows, entry);
-        am_freerow(solver, (am_Row *)entry);
-    }
+    am_Solver *solver = cons ? cons->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_RESETCONSTRAINT);
+    if (rec != NULL)
+        am_reccons(rec, cons);
+    am_resetconstraint_impl(cons);
+    am_recend(solver);
 }
 
-AM_API void am_updatevars(am_Solver *solver)
+AM_API void am_delconstraint(am_Constraint *cons)
 {
-    while (am_Symbol_id(solver->dirty_vars) != 0) {
-        am_Variable *var = am_sym2var(solver, solver->dirty_vars);
-        am_Row *row = (am_Row *)am_gettable(&solver->rows, var->sym);
-        solver->dirty_vars = var->dirty_next;
-        var->dirty_next = am_null();
-        var->value = row ? row->constant : 0.0f;
+    am_Solver *solver = cons ? cons->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_DELCONSTRAINT);
+    if (rec != NULL)
+        am_reccons(rec, cons);
+    am_delconstraint_impl(cons);
+    am_recend(solver);
+}
+
+static int am_recgroupcall(am_Constraint **cons, size_t count, int op,
+                           int (*f)(am_Constraint **, size_t))
+{
+    am_Solver *solver = am_conssolver(cons, count);
+    am_Recorder *rec = am_recgroup(solver, op, count);
+    size_t i;
+    int ret;
+    for (i = 0; rec != NULL && i < count; ++i)
+        am_reccons(rec, cons[i]);
+    ret = f(cons, count);
+    am_recend(solver);
+    return ret;
+}
+
+AM_API int am_addgroup(am_Constraint **cons, size_t count)
+{
+    return am_recgroupcall(cons, count, AM_REC_ADDGROUP, am_addgroup_impl);
+}
+
+AM_API int am_disablegroup(am_Constraint **cons, size_t count)
+{
+    return am_recgroupcall(cons, count, AM_REC_DISABLEGROUP,
+                           am_disablegroup_impl);
+}
+
+AM_API int am_enablegroup(am_Constraint **cons, size_t count)
+{
+    return am_recgroupcall(cons, count, AM_REC_ENABLEGROUP,
+                           am_enablegroup_impl);
+}
+
+AM_API int am_setstrength(am_Constraint *cons, am_Float strength)
+{
+    am_Solver *solver = cons ? cons->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_SETSTRENGTH);
+    int ret;
+    if (rec != NULL)
+        am_reccons(rec, cons), am_recfloat(rec, strength);
+    ret = am_setstrength_impl(cons, strength);
+    am_recend(solver);
+    return ret;
+}
+
+AM_API int am_addterm(am_Constraint *cons, am_Variable *var,
+                      am_Float multiplier)
+{
+    am_Solver *solver = cons ? cons->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_ADDTERM);
+    int ret;
+    if (rec != NULL) {
+        am_reccons(rec, cons), am_recvar(rec, var);
+        am_recfloat(rec, multiplier);
     }
+    ret = am_addterm_impl(cons, var, multiplier);
+    am_recend(solver);
+    return ret;
 }
 
-AM_API int am_add(am_Constraint *cons)
+AM_API int am_mergeconstraint(am_Constraint *cons, am_Constraint *other,
+                              am_Float multiplier)
 {
     am_Solver *solver = cons ? cons->solver : NULL;
-    int ret, oldsym = solver ? solver->symbol_count : 0;
-    am_Row row;
-    if (solver == NULL || am_Symbol_id(cons->marker) != 0)
-        return AM_FAILED;
-    row = am_makerow(solver, cons);
-    if ((ret = am_try_addrow(solver, &row, cons)) != AM_OK) {
-        am_remove_errors(solver, cons);
-        solver->symbol_count = oldsym;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_MERGECONSTRAINT);
+    int ret;
+    if (rec != NULL) {
+        am_reccons(rec, cons), am_reccons(rec, other);
+        am_recfloat(rec, multiplier);
     }
-    else {
-        am_optimize(solver, &solver->objective);
-        if (solver->auto_update)
-            am_updatevars(solver);
+    ret = am_mergeconstraint_impl(cons, other, multiplier);
+    am_recend(solver);
+    return ret;
+}
+
+AM_API am_Constraint *am_cloneconstraint(am_Constraint *other,
+                                         am_Float strength)
+{
+    am_Solver *solver = other ? other->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_CLONECONSTRAINT);
+    am_Constraint *cons = am_cloneconstraint_impl(other, strength);
+    if (rec != NULL) { /* the id of the clone is known only now */
+        am_reccons(rec, cons), am_reccons(rec, other);
+        am_recfloat(rec, strength);
     }
+    am_recend(solver);
+    return cons;
+}
+
+static int am_recvarcall(am_Variable *var, int op, int (*f)(am_Variable *))
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, op);
+    int ret;
+    if (rec != NULL)
+        am_recvar(rec, var);
+    ret = f(var);
+    am_recend(solver);
     return ret;
 }
 
-AM_API void am_remove(am_Constraint *cons)
+AM_API int am_suspendedit(am_Variable *var)
 {
-    am_Solver *solver;
-    am_Symbol marker;
-    am_Row tmp;
-    if (cons == NULL || am_Symbol_id(cons->marker) == 0)
-        return;
-    solver = cons->solver, marker = cons->marker;
-    am_remove_errors(solver, cons);
-    if (am_getrow(solver, marker, &tmp) != AM_OK) {
-        am_Symbol exit = am_get_leaving_row(solver, marker);
-        assert(am_Symbol_id(exit) != 0);
-        am_getrow(solver, exit, &tmp);
-        am_solvefor(solver, &tmp, marker, exit);
-        am_substitute_rows(solver, marker, &tmp);
+    return am_recvarcall(var, AM_REC_SUSPENDEDIT, am_suspendedit_impl);
+}
+
+AM_API int am_resumeedit(am_Variable *var)
+{
+    return am_recvarcall(var, AM_REC_RESUMEEDIT, am_resumeedit_impl);
+}
+
+AM_API void am_deledit(am_Variable *var)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_DELEDIT);
+    if (rec != NULL)
+        am_recvar(rec, var);
+    am_deledit_impl(var);
+    am_recend(solver);
+}
+
+AM_API void am_delvariable(am_Variable *var)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_DELVARIABLE);
+    if (rec != NULL)
+        am_recvar(rec, var);
+    am_delvariable_impl(var);
+    am_recend(solver);
+}
+
+AM_API int am_addedit(am_Variable *var, am_Float strength)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_ADDEDIT);
+    int ret;
+    if (rec != NULL)
+        am_recvar(rec, var), am_recfloat(rec, strength);
+    ret = am_addedit_impl(var, strength);
+    am_recend(solver);
+    return ret;
+}
+
+AM_API void am_suggest(am_Variable *var, am_Float value)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_SUGGEST);
+    if (rec != NULL)
+        am_recvar(rec, var), am_recfloat(rec, value);
+    am_suggest_impl(var, value);
+    am_recend(solver);
+}
+
+AM_API int am_sweep(am_Variable *var, am_Float from, am_Float to,
+                    am_Variable **vars, size_t count, am_Sweepf *f, void *ud)
+{
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_SWEEP);
+    size_t i;
+    int ret;
+    if (rec != NULL) {
+        am_recvar(rec, var), am_recfloat(rec, from), am_recfloat(rec, to);
+        am_recuint(rec, vars ? count : 0);
+        for (i = 0; vars != NULL && i < count; ++i)
+            am_recvar(rec, vars[i]);
     }
-    am_freerow(solver, &tmp);
-    am_optimize(solver, &solver->objective);
-    if (solver->auto_update)
-        am_updatevars(solver);
+    ret = am_sweep_impl(var, from, to, vars, count, f, ud);
+    am_recend(solver);
+    return ret;
 }
 
-AM_API int am_setstrength(am_Constraint *cons, am_Float strength)
+AM_API int am_setbounds(am_Variable *var, am_Float lower, am_Float upper,
+                        am_Float strength)
 {
-    if (cons == NULL)
-        return AM_FAILED;
-    strength = am_nearzero(strength) ? AM_REQUIRED : strength;
-    if (cons->strength == strength)
-        return AM_OK;
-    if (cons->strength >= AM_REQUIRED || strength >= AM_REQUIRED) {
-        am_remove(cons), cons->strength = strength;
-        return am_add(cons);
+    am_Solver *solver = var ? var->solver : NULL;
+    am_Recorder *rec = am_recbegin(solver, AM_REC_SETBOUNDS);
+    int ret;
+    if (rec != NULL) {
+        am_recvar(rec, var), am_recfloat(rec, lower);
+        am_recfloat(rec, upper), am_recfloat(rec, strength);
     }
-    if (am_Symbol_id(cons->marker) != 0) {
-        am_Solver *solver = cons->solver;
-        am_Float diff = strength - cons->strength;
-        am_mergerow(solver, &solver->objective, cons->marker, diff);
-        am_mergerow(solver, &solver->objective, cons->other, diff);
-        am_optimize(solver, &solver->objective);
-        if (solver->auto_update)
-            am_updatevars(solver);
+    ret = am_setbounds_impl(var, lower, upper, strength);
+    am_recend(solver);
+    return ret;
+}
+
+static int am_recfrozen(am_Variable **vars, size_t count, int op,
+                        int (*f)(am_Variable **, size_t))
+{
+    am_Solver *solver = am_varsolver(vars, count);
+    am_Recorder *rec = am_recgroup(solver, op, count);
+    size_t i;
+    int ret;
+    for (i = 0; rec != NULL && i < count; ++i)
+        am_recvar(rec, vars[i]);
+    ret = f(vars, count);
+    am_recend(solver);
+    return ret;
+}
+
+AM_API int am_freeze(am_Variable **vars, size_t count)
+{
+    return am_recfrozen(vars, count, AM_REC_FREEZE, am_freeze_impl);
+}
+
+AM_API int am_thaw(am_Variable **vars, size_t count)
+{
+    return am_recfrozen(vars, count, AM_REC_THAW, am_thaw_impl);
+}
+
+AM_API int am_record(am_Solver *solver, const char *path)
+{
+    am_Recorder *rec = solver ? solver->recorder : NULL;
+    FILE *fp;
+    if (solver == NULL)
+        return AM_FAILED;
+    if (rec != NULL) {
+        fclose(rec->fp);
+        am_realloc(solver, rec, 0, sizeof(am_Recorder));
+        solver->recorder = NULL;
     }
-    cons->strength = strength;
+    if (path == NULL)
+        return AM_OK;
+    /* a replay starts from an empty solver */
+    if (solver->vars.count != 0 || solver->constraints.count != 0)
+        return AM_FAILED;
+    if ((fp = fopen(path, "wb")) == NULL)
+        return AM_FAILED;
+    rec = (am_Recorder *)am_realloc(solver, NULL, sizeof(am_Recorder), 0);
+    rec->fp = fp;
+    rec->depth = 0;
+    fwrite("AMRC\1", 1, 5, fp);
+    solver->recorder = rec;
+    putc(AM_REC_AUTOUPDATE, fp), am_recuint(rec, solver->auto_update);
+    putc(AM_REC_PRESOLVE, fp), am_recuint(rec, solver->presolve);
+    putc(AM_REC_COLUMNINDEX, fp), am_recuint(rec, solver->indexed);
+    putc(AM_REC_DIFFSOLVE, fp), am_recuint(rec, solver->diffsolve);
+    putc(AM_REC_MEMOIZE, fp), am_recuint(rec, solver->memo_size);
+    putc(AM_REC_SETBUDGET, fp), am_recuint(rec, solver->budget);
+    putc(AM_REC_AUTOREFACTOR, fp), am_recuint(rec, solver->refactor_interval);
     return AM_OK;
 }
 
-AM_API int am_addedit(am_Variable *var, am_Float strength)
+/* A replay maps the ids of the recording to the variables and constraints
+ * it makes, keyed as external symbols in tables of the target solver. */
+
+/* name and arguments of each call: u a number, f a float, i the id of a
+ * new object, v a variable, c a constraint, V and C a counted list */
+static const char *const am_reccalls[AM_REC_LAST + 1][2] = {
+    {NULL, NULL},
+    {"am_autoupdate", "u"}, {"am_presolve", "u"}, {"am_columnindex", "u"},
+    {"am_diffsolve", "u"}, {"am_memoize", "u"}, {"am_setbudget", "u"},
+    {"am_autorefactor", "u"}, {"am_resetsolver", "u"}, {"am_delsolver", ""},
+    {"am_updatevars", ""}, {"am_resume", ""}, {"am_refactor", ""},
+    {"am_add", "c"}, {"am_addgroup", "C"}, {"am_remove", "c"},
+    {"am_disable", "c"}, {"am_enable", "c"}, {"am_disablegroup", "C"},
+    {"am_enablegroup", "C"}, {"am_addedit", "vf"}, {"am_suggest", "vf"},
+    {"am_sweep", "vffV"}, {"am_deledit", "v"}, {"am_suspendedit", "v"},
+    {"am_resumeedit", "v"}, {"am_newvariable", "i"},
+    {"am_usevariable", "v"}, {"am_delvariable", "v"},
+    {"am_setbounds", "vfff"}, {"am_freeze", "V"}, {"am_thaw", "V"},
+    {"am_newconstraint", "if"}, {"am_cloneconstraint", "icf"},
+    {"am_resetconstraint", "c"}, {"am_delconstraint", "c"},
+    {"am_addterm", "cvf"}, {"am_setrelation", "cu"},
+    {"am_addconstant", "cf"}, {"am_setstrength", "cf"},
+    {"am_mergeconstraint", "ccf"},
+};
+
+static size_t am_readuint(FILE *fp, int *eof)
 {
-    am_Solver *solver = var ? var->solver : NULL;
-    am_Constraint *cons;
-    if (var == NULL || var->constraint != NULL)
+    size_t v = 0;
+    int c, shift = 0;
+    do {
+        /* cut off, or too long for a size_t */
+        if (shift >= (int)sizeof(size_t) * 8 || (c = getc(fp)) == EOF) {
+            *eof = 1;
+            return 0;
+        }
+        v |= (size_t)(c & 0x7f) << shift, shift += 7;
+    } while (c & 0x80);
+    return v;
+}
+
+static am_Float am_readfloat(FILE *fp, int *eof)
+{
+    uint64_t bits = 0;
+    double d;
+    int i, c;
+    for (i = 0; i < 8; ++i) {
+        if ((c = getc(fp)) == EOF) {
+            *eof = 1;
+            return 0.0f;
+        }
+        bits |= (uint64_t)c << (8 * i);
+    }
+    memcpy(&d, &bits, sizeof(d));
+    return (am_Float)d;
+}
+
+/* Objects are mapped from the ids in the log to their symbols in the
+ * solver, and found through the solver's own tables, so an object freed
+ * by a replayed call, even as a side effect, is never handed out again. */
+
+static am_ReplayEntry *am_replayentry(am_Table *t, size_t id)
+{
+    am_Symbol key;
+    if (id == 0 || id > (~0u >> 2))
+        return NULL; /* not a symbol id */
+    am_Symbol_set(&key, (unsigned)id, AM_EXTERNAL);
+    return (am_ReplayEntry *)am_gettable(t, key);
+}
+
+static int am_replaymap(am_Solver *solver, am_Table *t, size_t id,
+                        am_Symbol sym)
+{
+    am_ReplayEntry *re;
+    am_Symbol key;
+    if (id == 0 || id > (~0u >> 2) || am_replayentry(t, id) != NULL)
         return AM_FAILED;
-    assert(am_Symbol_id(var->sym) != 0);
-    if (strength >= AM_STRONG)
-        strength = AM_STRONG;
-    cons = am_newconstraint(solver, strength);
-    am_setrelation(cons, AM_EQUAL);
-    am_addterm(cons, var, 1.0f); /* var must have positive signture */
-    am_addconstant(cons, -var->value);
-    if (am_add(cons) != AM_OK)
-        assert(0);
-    var->constraint = cons;
-    var->edit_value = var->value;
+    am_Symbol_set(&key, (unsigned)id, AM_EXTERNAL);
+    re = (am_ReplayEntry *)am_settable(solver, t, key);
+    re->sym = sym;
     return AM_OK;
 }
 
-AM_API void am_deledit(am_Variable *var)
+static am_Variable *am_replayvar(am_Solver *solver, am_Table *vars,
+                                 size_t id)
 {
-    if (var == NULL || var->constraint == NULL)
-        return;
-    am_delconstraint(var->constraint);
-    var->constraint = NULL;
-    var->edit_value = 0.0f;
+    am_ReplayEntry *re = am_replayentry(vars, id);
+    am_VarEntry *ve = re ? (am_VarEntry *)am_gettable(&solver->vars, re->sym)
+                         : NULL;
+    return ve ? ve->variable : NULL;
 }
 
-AM_API void am_suggest(am_Variable *var, am_Float value)
+static am_Constraint *am_replaycons(am_Solver *solver, am_Table *conses,
+                                    size_t id)
 {
-    am_Solver *solver = var ? var->solver : NULL;
-    am_Float delta;
-    if (var == NULL)
-        return;
-    if (var->constraint == NULL) {
-        am_addedit(var, AM_MEDIUM);
-        assert(var->constraint != NULL);
+    am_ReplayEntry *re = am_replayentry(conses, id);
+    am_ConsEntry *ce = re ? (am_ConsEntry *)am_gettable(&solver->constraints,
+                                                        re->sym)
+                          : NULL;
+    return ce ? ce->constraint : NULL;
+}
+
+static void am_replayforget(am_Table *t, const am_Table *objects, size_t id)
+{
+    /* drop the id once the solver no longer has its object */
+    am_ReplayEntry *re = am_replayentry(t, id);
+    if (re != NULL && am_gettable(objects, re->sym) == NULL)
+        am_delkey(t, &re->entry);
+}
+
+static void am_replaysweep(void *ud, am_Float from, am_Float to,
+                           const am_Float *values, const am_Float *slopes)
+{
+    (void)ud, (void)from, (void)to, (void)values, (void)slopes;
+}
+
+AM_API int am_replay(am_Solver *solver, const char *path, am_Replayf *f,
+                     void *ud)
+{
+    am_Table vars, conses;
+    am_Variable *var;
+    am_Constraint *cons[2];
+    am_Float x[3];
+    void **group = NULL;
+    size_t i, n, id, vid, cid, group_size = 0;
+    const char *arg;
+    char magic[5];
+    long size;
+    int op, nc, nx, eof = 0, ret = AM_OK;
+    FILE *fp;
+    if (solver == NULL || path == NULL || (fp = fopen(path, "rb")) == NULL)
+        return AM_FAILED;
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET) != 0 || fread(magic, 1, 5, fp) != 5 ||
+        memcmp(magic, "AMRC\1", 5) != 0) {
+        fclose(fp);
+        return AM_FAILED;
     }
-    delta = value - var->edit_value;
-    var->edit_value = value;
-    am_delta_edit_constant(solver, delta, var->constraint);
-    am_dual_optimize(solver);
-    if (solver->auto_update)
-        am_updatevars(solver);
+    am_inittable(&vars, sizeof(am_VarEntry));
+    am_inittable(&conses, sizeof(am_ConsEntry));
+    while ((op = getc(fp)) != EOF && op != AM_REC_DELSOLVER) {
+        if (op < 1 || op > AM_REC_LAST) {
+            ret = AM_FAILED;
+            break;
+        }
+        var = NULL, cons[0] = cons[1] = NULL, nc = nx = 0;
+        n = id = vid = cid = 0;
+        for (arg = am_reccalls[op][1]; *arg != '\0' && !eof; ++arg) {
+            switch (*arg) {
+            case 'u': n = am_readuint(fp, &eof); break;
+            case 'i': id = am_readuint(fp, &eof); break;
+            case 'f': x[nx++] = am_readfloat(fp, &eof); break;
+            case 'v':
+                vid = am_readuint(fp, &eof);
+                var = am_replayvar(solver, &vars, vid);
+                break;
+            case 'c':
+                cid = am_readuint(fp, &eof);
+                cons[nc++] = am_replaycons(solver, &conses, cid);
+                break;
+            default: /* V or C */
+                n = am_readuint(fp, &eof);
+                /* every id takes a byte at least */
+                if (n > (size_t)(size - ftell(fp)) ||
+                    n > AM_MAX_SIZET / sizeof(void *)) {
+                    eof = 1;
+                    break;
+                }
+                if (n > group_size) {
+                    group = (void **)am_realloc(solver, group,
+                            n * sizeof(void *), group_size * sizeof(void *));
+                    group_size = n;
+                }
+                for (i = 0; i < n && !eof; ++i) {
+                    id = am_readuint(fp, &eof);
+                    group[i] = *arg == 'V'
+                                   ? (void *)am_replayvar(solver, &vars, id)
+                                   : (void *)am_replaycons(solver, &conses, id);
+                }
+            }
+        }
+        if (eof || (op == AM_REC_SETRELATION &&
+                    (n < AM_LESSEQUAL || n > AM_GREATEQUAL)) ||
+            ((op == AM_REC_NEWVARIABLE || op == AM_REC_NEWCONSTRAINT ||
+              op == AM_REC_CLONECONSTRAINT) &&
+             (id == 0 || id > (~0u >> 2) ||
+              am_replayentry(op == AM_REC_NEWVARIABLE ? &vars : &conses,
+                             id) != NULL))) {
+            ret = AM_FAILED;
+            break;
+        }
+        if (f != NULL)
+            f(ud, am_reccalls[op][0], 0);
+        switch (op) {
+        case AM_REC_AUTOUPDATE: am_autoupdate(solver, (int)n); break;
+        case AM_REC_PRESOLVE: am_presolve(solver, (int)n); break;
+        case AM_REC_COLUMNINDEX: am_columnindex(solver, (int)n); break;
+        case AM_REC_DIFFSOLVE: am_diffsolve(solver, (int)n); break;
+        case AM_REC_MEMOIZE: am_memoize(solver, (unsigned)n); break;
+        case AM_REC_SETBUDGET: am_setbudget(solver, (unsigned)n); break;
+        case AM_REC_AUTOREFACTOR: am_autorefactor(solver, (unsigned)n); break;
+        case AM_REC_RESETSOLVER: am_resetsolver(solver, (int)n); break;
+        case AM_REC_UPDATEVARS: am_updatevars(solver); break;
+        case AM_REC_RESUME: am_resume(solver); break;
+        case AM_REC_REFACTOR: am_refactor(solver); break;
+        case AM_REC_ADD: am_add(cons[0]); break;
+        case AM_REC_ADDGROUP: am_addgroup((am_Constraint **)group, n); break;
+        case AM_REC_REMOVE: am_remove(cons[0]); break;
+        case AM_REC_DISABLE: am_disable(cons[0]); break;
+        case AM_REC_ENABLE: am_enable(cons[0]); break;
+        case AM_REC_DISABLEGROUP:
+            am_disablegroup((am_Constraint **)group, n);
+            break;
+        case AM_REC_ENABLEGROUP:
+            am_enablegroup((am_Constraint **)group, n);
+            break;
+        case AM_REC_ADDEDIT: am_addedit(var, x[0]); break;
+        case AM_REC_SUGGEST: am_suggest(var, x[0]); break;
+        case AM_REC_SWEEP:
+            am_sweep(var, x[0], x[1], (am_Variable **)group, n,
+                     am_replaysweep, NULL);
+            break;
+        case AM_REC_DELEDIT: am_deledit(var); break;
+        case AM_REC_SUSPENDEDIT: am_suspendedit(var); break;
+        case AM_REC_RESUMEEDIT: am_resumeedit(var); break;
+        case AM_REC_NEWVARIABLE:
+            var = am_newvariable(solver);
+            am_replaymap(solver, &vars, id, var->sym);
+            break;
+        case AM_REC_USEVARIABLE: am_usevariable(var); break;
+        case AM_REC_DELVARIABLE:
+            am_delvariable(var);
+            am_replayforget(&vars, &solver->vars, vid);
+            break;
+        case AM_REC_SETBOUNDS: am_setbounds(var, x[0], x[1], x[2]); break;
+        case AM_REC_FREEZE: am_freeze((am_Variable **)group, n); break;
+        case AM_REC_THAW: am_thaw((am_Variable **)group, n); break;
+        case AM_REC_NEWCONSTRAINT:
+        case AM_REC_CLONECONSTRAINT:
+            cons[1] = op == AM_REC_NEWCONSTRAINT
+                          ? am_newconstraint(solver, x[0])
+                          : am_cloneconstraint(cons[0], x[0]);
+            if (cons[1] != NULL)
+                am_replaymap(solver, &conses, id, am_key(cons[1]));
+            break;
+        case AM_REC_RESETCONSTRAINT: am_resetconstraint(cons[0]); break;
+        case AM_REC_DELCONSTRAINT:
+            am_delconstraint(cons[0]);
+            am_replayforget(&conses, &solver->constraints, cid);
+            break;
+        case AM_REC_ADDTERM: am_addterm(cons[0], var, x[0]); break;
+        case AM_REC_SETRELATION: am_setrelation(cons[0], (int)n); break;
+        case AM_REC_ADDCONSTANT: am_addconstant(cons[0], x[0]); break;
+        case AM_REC_SETSTRENGTH: am_setstrength(cons[0], x[0]); break;
+        case AM_REC_MERGECONSTRAINT:
+            am_mergeconstraint(cons[0], cons[1], x[0]);
+            break;
+        }
+        if (f != NULL)
+            f(ud, am_reccalls[op][0], 1);
+    }
+    if (group != NULL)
+        am_realloc(solver, group, 0, group_size * sizeof(void *));
+    am_freetable(solver, &vars);
+    am_freetable(solver, &conses);
+    fclose(fp);
+    return ret;
 }
 
 AM_NS_END
@@ -42,6 +42,7 @@
 #define AM_FAILED (-1)
 #define AM_UNSATISFIED (-2)
 #define AM_UNBOUND (-3)
+#define AM_INCOMPLETE (-4)
 
 #define AM_LESSEQUAL (1)
 #define AM_EQUAL (2)
@@ -68,28 +69,156 @@ typedef struct am_Constraint am_Constraint;
 
 typedef void *am_Allocf(void *ud, void *ptr, size_t nsize, size_t osize);
 
+/* counters need AM_USE_STATS, the tableau sizes are always filled in */
+typedef struct am_Stats {
+    size_t primal_pivots;
+    size_t dual_pivots;
+    size_t artificials;     /* constraints added with an artificial variable */
+    size_t rows_scanned;    /* by the substitution after each pivot */
+    size_t rows_modified;
+    size_t table_resizes;
+    size_t bytes_allocated; /* held through allocf now, not reset */
+    size_t rows;
+    size_t nonzeros;
+    size_t objective_terms;
+} am_Stats;
+
+#define AM_TRACE_BEGIN (1)      /* an operation starts */
+#define AM_TRACE_END (2)        /* and returns result */
+#define AM_TRACE_PIVOT (3)
+
+#define AM_TRACE_ADD (1)        /* operations of begin and end */
+#define AM_TRACE_REMOVE (2)
+#define AM_TRACE_SUGGEST (3)
+
+#define AM_TRACE_PRIMAL (1)     /* phases of a pivot */
+#define AM_TRACE_DUAL (2)
+#define AM_TRACE_ARTIFICIAL (3)
+
+typedef struct am_TraceEvent {
+    int kind;
+    int what;                   /* operation, or phase of a pivot */
+    am_Constraint *constraint;  /* added or removed */
+    am_Variable *variable;      /* suggested */
+    int result;
+    unsigned entering;          /* symbol ids of the pivot */
+    unsigned leaving;
+    size_t row_terms;           /* length of the pivot row */
+    size_t rows;                /* rows in the tableau */
+    am_Float ratio;             /* won the ratio test */
+} am_TraceEvent;
+
+typedef void am_Tracef(void *ud, const am_TraceEvent *ev);
+
+/* around each replayed call, done is 0 before it and 1 after */
+typedef void am_Replayf(void *ud, const char *call, int done);
+
+/* operations am_latency times */
+#define AM_LAT_ADD (0)
+#define AM_LAT_REMOVE (1)
+#define AM_LAT_SUGGEST (2)
+#define AM_LAT_UPDATEVARS (3)
+#define AM_LAT_SETSTRENGTH (4)
+#define AM_LAT_OPS (5)
+
+/* in microseconds, read from buckets within 1/32 of their value */
+typedef struct am_Latency {
+    size_t count;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+} am_Latency;
+
+/* lengths are counted by powers of two: 0, 1, 2-3, 4-7, ..., the last
+ * bucket taking everything longer */
+#define AM_HEALTH_BUCKETS (12)
+
+/* the shape of the tableau, coefficients in absolute value */
+typedef struct am_Health {
+    size_t rows;
+    size_t nonzeros;
+    size_t max_row_length;
+    size_t row_lengths[AM_HEALTH_BUCKETS];   /* rows by their terms */
+    size_t columns;                          /* symbols in some row */
+    size_t max_column_count;
+    size_t column_counts[AM_HEALTH_BUCKETS]; /* symbols by rows they're in */
+    size_t basic[4];        /* row keys: external, slack, error, dummy */
+    size_t objective_terms;
+    size_t near_epsilon;    /* terms under 1000 times the pruning epsilon */
+    am_Float min_coefficient; /* over the rows and the objective */
+    am_Float max_coefficient;
+} am_Health;
+
+/* one piece of a sweep: vars[i] == values[i] + slopes[i] * (t - from) */
+typedef void am_Sweepf(void *ud, am_Float from, am_Float to,
+                       const am_Float *values, const am_Float *slopes);
+
 AM_API am_Solver *am_newsolver(am_Allocf *allocf, void *ud);
 AM_API void am_resetsolver(am_Solver *solver, int clear_constraints);
 AM_API void am_delsolver(am_Solver *solver);
 
 AM_API void am_updatevars(am_Solver *solver);
 AM_API void am_autoupdate(am_Solver *solver, int auto_update);
+/* removing a presolved constraint rebuilds the whole tableau, which
+ * costs about as much as adding every constraint again, see
+ * BM_presolve_remove */
+AM_API void am_presolve(am_Solver *solver, int enable);
+AM_API void am_columnindex(am_Solver *solver, int enable);
+AM_API void am_diffsolve(am_Solver *solver, int enable);
+AM_API void am_memoize(am_Solver *solver, unsigned states);
+AM_API void am_memostats(am_Solver *solver, size_t *hits, size_t *misses);
+AM_API int am_getstats(am_Solver *solver, am_Stats *stats);
+AM_API void am_resetstats(am_Solver *solver);
+AM_API int am_gethealth(am_Solver *solver, am_Health *health);
+AM_API int am_latency(am_Solver *solver, int enable);
+AM_API int am_getlatency(am_Solver *solver, int op, am_Latency *latency);
+AM_API void am_resetlatency(am_Solver *solver);
+AM_API void am_settrace(am_Solver *solver, am_Tracef *f, void *ud);
+AM_API int am_tracefile(am_Solver *solver, const char *path);
+AM_API int am_record(am_Solver *solver, const char *path);
+AM_API int am_replay(am_Solver *solver, const char *path, am_Replayf *f,
+                     void *ud);
+
+AM_API void am_setbudget(am_Solver *solver, unsigned max_pivots);
+AM_API int am_incomplete(am_Solver *solver);
+AM_API int am_resume(am_Solver *solver);
+
+AM_API int am_refactor(am_Solver *solver);
+AM_API void am_autorefactor(am_Solver *solver, unsigned pivots);
 
 AM_API int am_hasedit(am_Variable *var);
 AM_API int am_hasconstraint(am_Constraint *cons);
 
 AM_API int am_add(am_Constraint *cons);
+AM_API int am_addgroup(am_Constraint **cons, size_t count);
 AM_API void am_remove(am_Constraint *cons);
 
+AM_API int am_disable(am_Constraint *cons);
+AM_API int am_enable(am_Constraint *cons);
+AM_API int am_isdisabled(am_Constraint *cons);
+AM_API int am_disablegroup(am_Constraint **cons, size_t count);
+AM_API int am_enablegroup(am_Constraint **cons, size_t count);
+
 AM_API int am_addedit(am_Variable *var, am_Float strength);
 AM_API void am_suggest(am_Variable *var, am_Float value);
+AM_API int am_sweep(am_Variable *var, am_Float from, am_Float to,
+                    am_Variable **vars, size_t count, am_Sweepf *f, void *ud);
 AM_API void am_deledit(am_Variable *var);
+AM_API int am_bind(am_Variable *var, am_Variable *source, am_Float strength);
+AM_API void am_unbind(am_Variable *var);
+AM_API int am_suspendedit(am_Variable *var);
+AM_API int am_resumeedit(am_Variable *var);
 
 AM_API am_Variable *am_newvariable(am_Solver *solver);
 AM_API void am_usevariable(am_Variable *var);
 AM_API void am_delvariable(am_Variable *var);
 AM_API int am_variableid(am_Variable *var);
 AM_API am_Float am_value(am_Variable *var);
+AM_API int am_setbounds(am_Variable *var, am_Float lower, am_Float upper,
+                        am_Float strength);
+AM_API int am_freeze(am_Variable **vars, size_t count);
+AM_API int am_thaw(am_Variable **vars, size_t count);
 
 AM_API am_Constraint *am_newconstraint(am_Solver *solver, am_Float strength);
 AM_API am_Constraint *am_cloneconstraint(am_Constraint *other,
@@ -1,3 +1,7 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L /* clock_gettime, for am_nanotime */
+#endif
+
 #define AM_IMPLEMENTATION
 #include "amoeba.h"
 
@@ -8,6 +12,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h> /* QueryPerformanceCounter, for am_nanotime */
+#endif
 
 #define AM_EXTERNAL (0)
 #define AM_SLACK (1)
@@ -32,6 +42,49 @@
 #define AM_FLOAT_EPS 1e-6
 #endif
 
+/* calls in a recording, one byte each before the arguments */
+#define AM_REC_AUTOUPDATE (1)
+#define AM_REC_PRESOLVE (2)
+#define AM_REC_COLUMNINDEX (3)
+#define AM_REC_DIFFSOLVE (4)
+#define AM_REC_MEMOIZE (5)
+#define AM_REC_SETBUDGET (6)
+#define AM_REC_AUTOREFACTOR (7)
+#define AM_REC_RESETSOLVER (8)
+#define AM_REC_DELSOLVER (9)
+#define AM_REC_UPDATEVARS (10)
+#define AM_REC_RESUME (11)
+#define AM_REC_REFACTOR (12)
+#define AM_REC_ADD (13)
+#define AM_REC_ADDGROUP (14)
+#define AM_REC_REMOVE (15)
+#define AM_REC_DISABLE (16)
+#define AM_REC_ENABLE (17)
+#define AM_REC_DISABLEGROUP (18)
+#define AM_REC_ENABLEGROUP (19)
+#define AM_REC_ADDEDIT (20)
+#define AM_REC_SUGGEST (21)
+#define AM_REC_SWEEP (22)
+#define AM_REC_DELEDIT (23)
+#define AM_REC_SUSPENDEDIT (24)
+#define AM_REC_RESUMEEDIT (25)
+#define AM_REC_NEWVARIABLE (26)
+#define AM_REC_USEVARIABLE (27)
+#define AM_REC_DELVARIABLE (28)
+#define AM_REC_SETBOUNDS (29)
+#define AM_REC_FREEZE (30)
+#define AM_REC_THAW (31)
+#define AM_REC_NEWCONSTRAINT (32)
+#define AM_REC_CLONECONSTRAINT (33)
+#define AM_REC_RESETCONSTRAINT (34)
+#define AM_REC_DELCONSTRAINT (35)
+#define AM_REC_ADDTERM (36)
+#define AM_REC_SETRELATION (37)
+#define AM_REC_ADDCONSTANT (38)
+#define AM_REC_SETSTRENGTH (39)
+#define AM_REC_MERGECONSTRAINT (40)
+#define AM_REC_LAST AM_REC_MERGECONSTRAINT
+
 AM_NS_BEGIN
 
 typedef struct am_Symbol {
@@ -83,12 +136,116 @@ typedef struct am_Row {
     am_Float constant;
 } am_Row;
 
+typedef struct am_Sense {
+    am_Row *row;
+    am_Variable *var;     /* to mark dirty: the row's own or bound variable */
+    am_Float multiplier;
+} am_Sense;
+
+typedef struct am_VarValue {
+    am_Variable *var;
+    am_Float value;
+} am_VarValue;
+
+typedef struct am_Memo {
+    unsigned generation;  /* constraint set the state was solved for */
+    unsigned last_used;
+    size_t edit_count;
+    size_t value_count;
+    am_VarValue *edits;   /* edit variables and their edit values */
+    am_VarValue *values;  /* the solved value of every variable */
+} am_Memo;
+
+typedef struct am_DiffEdge {
+    am_Entry entry;       /* key: the constraint */
+    am_Variable *var;     /* the variable at the other end */
+    am_Float weight;
+} am_DiffEdge;
+
+typedef struct am_DiffNode {
+    am_Entry entry;       /* key: the variable */
+    am_Variable *var;
+    am_Table out;         /* edges to variables >= this one + weight */
+    am_Table in;          /* edges from variables this one is >= + weight */
+    am_Float value;
+    am_Float change;      /* best change the current pass found for it */
+    unsigned pass;        /* pass that reached the node */
+    unsigned settled;     /* pass that fixed its change */
+} am_DiffNode;
+
+typedef struct am_DiffStep {
+    am_DiffNode *node;
+    am_Float change;      /* a pending change, or the value to restore */
+} am_DiffStep;
+
+typedef struct am_Infeasible {
+    am_Symbol row;
+    am_Float violation;   /* when it was pushed, refreshed on the way out */
+} am_Infeasible;
+
+typedef struct am_Column {
+    am_Entry entry;
+    am_Table rows;        /* keys of the rows mentioning the symbol */
+} am_Column;
+
+typedef struct am_ReplayEntry {
+    am_Entry entry;       /* keyed by the id in the log */
+    am_Symbol sym;        /* of the object made for it in the solver */
+} am_ReplayEntry;
+
+typedef struct am_Recorder {
+    FILE *fp;
+    unsigned depth;       /* calls under way, only the outermost is logged */
+} am_Recorder;
+
+/* log-linear latency buckets: exact below 2 * AM_LAT_SUB nanoseconds,
+ * then AM_LAT_SUB buckets for every doubling up to about 18 minutes */
+#define AM_LAT_SUB 16
+#define AM_LAT_BUCKETS (AM_LAT_SUB * 37)
+
+typedef struct am_Histogram {
+    size_t count;
+    size_t max;           /* nanoseconds */
+    unsigned buckets[AM_LAT_BUCKETS];
+} am_Histogram;
+
+typedef struct am_Timing {
+    unsigned depth;       /* calls under way, only the outermost is timed */
+    int op;               /* AM_LAT_* of the outermost call, or -1 */
+    size_t start;
+    am_Histogram ops[AM_LAT_OPS];
+} am_Timing;
+
+typedef struct am_TraceFile {
+    FILE *fp;
+    size_t start;         /* timestamps count from here, in ns */
+    size_t events;
+    size_t pivot_start;   /* the pivot written once the next event comes */
+    am_TraceEvent pivot;
+    int pending;
+} am_TraceFile;
+
 struct am_Variable {
     am_Symbol sym;
     am_Symbol dirty_next;
     unsigned refcount;
     am_Solver *solver;
     am_Constraint *constraint;
+    am_Variable *source;  /* variable of the parent solver it follows */
+    am_Variable *followers; /* variables of child solvers following it */
+    am_Variable *next_follower;
+    am_Variable *alias;   /* presolve: value = scale * alias + offset */
+    am_Float scale;
+    am_Float offset;      /* presolve: the value itself when fixed */
+    unsigned fixed;
+    unsigned frozen;      /* fixed at offset until thawed */
+    unsigned intableau;   /* referenced by some row, can't be aliased */
+    unsigned indiff;      /* value kept by the difference graph */
+    am_Symbol bound;      /* restricted symbol standing in for the value */
+    unsigned flipped;     /* value = upper - bound instead of lower + bound */
+    am_Float lower;
+    am_Float upper;
+    am_Constraint *limits[2]; /* bounds that are kept as rows */
     am_Float edit_value;
     am_Float value;
 };
@@ -98,29 +255,109 @@ struct am_Constraint {
     am_Symbol marker;
     am_Symbol other;
     int relation;
+    unsigned disabled;
+    am_Symbol presolved;  /* variable aliased instead of adding a row */
     am_Solver *solver;
     am_Float strength;
+    am_Sense *sense;      /* edits: the rows the edit constant moves */
+    unsigned sense_count;
+    unsigned sense_size;
+    unsigned sense_revision; /* tableau revision sense was built for */
+    unsigned indiff;      /* kept as edges of the difference graph */
 };
 
 struct am_Solver {
     am_Allocf *allocf;
     void *ud;
+    am_Solver *parent;    /* solver the bound variables follow */
+    am_Solver *children;  /* solvers with variables bound to this one */
+    am_Solver *next_child;
+    unsigned bound_count;
+    unsigned stale;       /* a source changed since the last update */
     am_Row objective;
     am_Table vars;        /* symbol -> VarEntry */
     am_Table constraints; /* symbol -> ConsEntry */
     am_Table rows;        /* symbol -> Row */
+    am_Table bounds;      /* bound symbol -> VarEntry */
+    am_Table columns;     /* symbol -> Column, when indexed */
+    am_Table diffnodes;   /* symbol -> DiffNode */
     am_MemPool varpool;
     am_MemPool conspool;
     unsigned symbol_count;
     unsigned constraint_count;
     unsigned auto_update;
+    unsigned presolve;
+    unsigned indexed;     /* keep the column index up to date */
+    unsigned diffsolve;   /* route difference constraints to the graph */
+    unsigned diff_pass;
+    unsigned frozen_count; /* variables frozen, 0 skips the checks */
+    unsigned budget;      /* max pivots per call, 0 for no limit */
+    unsigned pivots_left;
+    unsigned incomplete;  /* primal phase stopped by the budget */
+    unsigned refactor_interval; /* pivots between refactors, 0 for never */
+    unsigned pivot_count; /* pivots since the tableau was last rebuilt */
+    unsigned refactoring; /* rows being rebuilt, don't start over */
+    unsigned revision;    /* bumped whenever rows move or change shape */
+    unsigned generation;  /* bumped by every change to the constraint set */
+    am_Memo *memo;        /* recently solved states, memo_size of them */
+    unsigned memo_size;
+    unsigned memo_clock;
+    unsigned memo_pending; /* values came from memo, rows left to solve */
+    am_Memo *memo_hit;    /* values for the next am_updatevars */
+    size_t memo_hits;
+    size_t memo_misses;
+    am_DiffStep *diff_heap; /* changes to settle, largest first */
+    size_t heap_count;
+    size_t heap_size;
+    am_DiffStep *diff_undo; /* old values, to back out a positive cycle */
+    size_t undo_count;
+    size_t undo_size;
     am_Symbol infeasible_rows;
+    am_Infeasible *infeasible_heap; /* with native bounds, worst first */
+    size_t infeasible_count;
+    size_t infeasible_size;
     am_Symbol dirty_vars;
+    am_Tracef *tracef;    /* NULL when nothing listens */
+    void *trace_ud;
+    am_TraceFile *tracefile; /* the Chrome trace sink, when it is set */
+    am_Recorder *recorder; /* public calls are logged here, when set */
+#ifdef AM_USE_STATS
+    am_Stats stats;
+    am_Timing *timing;    /* latency histograms, when am_latency is on */
+#endif
 };
 
 int am_nextentry(const am_Table *t, am_Entry **pentry);
 int am_approx(am_Float a, am_Float b);
 
+#ifdef AM_USE_STATS
+#define am_count(solver, field, n) ((solver)->stats.field += (n))
+#else
+#define am_count(solver, field, n) ((void)(n))
+#endif
+
+/* USDT probes for perf and bpftrace, a nop each unless something attaches;
+ * on by default where <sys/sdt.h> exists, off with AM_NO_SDT */
+#if !defined(AM_USE_SDT) && !defined(AM_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define AM_USE_SDT
+#endif
+#endif
+
+#ifdef AM_USE_SDT
+#include <sys/sdt.h>
+#define am_probe2(name, a, b) DTRACE_PROBE2(amoeba, name, a, b)
+#define am_probe3(name, a, b, c) DTRACE_PROBE3(amoeba, name, a, b, c)
+#define am_probe5(name, a, b, c, d, e) DTRACE_PROBE5(amoeba, name, a, b, c, d, e)
+#define am_probe6(name, a, b, c, d, e, f) \
+    DTRACE_PROBE6(amoeba, name, a, b, c, d, e, f)
+#else
+#define am_probe2(name, a, b) ((void)0)
+#define am_probe3(name, a, b, c) ((void)0)
+#define am_probe5(name, a, b, c, d, e) ((void)0)
+#define am_probe6(name, a, b, c, d, e, f) ((void)0)
+#endif
+
 #define am_key(entry) (((am_Entry *)(entry))->key)
 
 #define am_offset(lhs, rhs) ((int)((char *)(lhs) - (char *)(rhs)))
@@ -1,4 +1,19 @@
+#if !defined(AM_BENCH_LITE) && defined(__has_include)
+#if !__has_include(<benchmark/benchmark.h>)
+#define AM_BENCH_LITE
+#endif
+#endif
+
+#ifdef AM_BENCH_LITE
+#include "bench_lite.h"
+#else
 #include <benchmark/benchmark.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
 
 #define ENABLE_MEMORY_ASSERT 0
 
@@ -15,6 +30,7 @@
 static jmp_buf jbuf;
 static size_t allmem = 0;
 static size_t maxmem = 0;
+static size_t peakmem = 0; /* like maxmem, but left alone by the tests */
 static void *END = NULL;
 
 #if ENABLE_MEMORY_ASSERT
@@ -31,6 +47,8 @@ static void *debug_allocf(void *ud, void *ptr, size_t ns, size_t os)
     allmem -= os;
     if (maxmem < allmem)
         maxmem = allmem;
+    if (peakmem < allmem)
+        peakmem = allmem;
     if (ns == 0)
         free(ptr);
     else {
@@ -50,61 +68,6 @@ static void *null_allocf(void *ud, void *ptr, size_t ns, size_t os)
     return NULL;
 }
 
-static void am_dumpkey(am_Symbol sym)
-{
-    int ch = 'v';
-    switch (sym.type) {
-    case AM_EXTERNAL:
-        ch = 'v';
-        break;
-    case AM_SLACK:
-        ch = 's';
-        break;
-    case AM_ERROR:
-        ch = 'e';
-        break;
-    case AM_DUMMY:
-        ch = 'd';
-        break;
-    }
-    printf("%c%d", ch, (int)sym.id);
-}
-
-static void am_dumprow(am_Row *row)
-{
-    am_Term *term = NULL;
-    printf("%g", row->constant);
-    while (am_nextentry(&row->terms, (am_Entry **)&term)) {
-        am_Float multiplier = term->multiplier;
-        printf(" %c ", multiplier > 0.0 ? '+' : '-');
-        if (multiplier < 0.0)
-            multiplier = -multiplier;
-        if (!am_approx(multiplier, 1.0f))
-            printf("%g*", multiplier);
-        am_dumpkey(am_key(term));
-    }
-    printf("\n");
-}
-
-static void am_dumpsolver(am_Solver *solver)
-{
-    if (!solver)
-        return;
-    am_Row *row = NULL;
-    int idx = 0;
-    printf("-------------------------------\n");
-    printf("solver: ");
-    am_dumprow(&solver->objective);
-    printf("rows(%d):\n", (int)solver->rows.count);
-    while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
-        printf("%d. ", ++idx);
-        am_dumpkey(am_key(row));
-        printf(" = ");
-        am_dumprow(row);
-    }
-    printf("-------------------------------\n");
-}
-
 static am_Constraint *new_constraint(am_Solver *in_solver, double in_strength,
                                      am_Variable *in_term1, double in_factor1,
                                      int in_relation, double in_constant, ...)
@@ -181,7 +144,7 @@ static void test_all()
     assert(am_setrelation(NULL, AM_GREATEQUAL) == AM_FAILED);
 
     c1 = am_newconstraint(solver, AM_REQUIRED);
-    assert(c1->marker.id == 0);
+    assert(am_Symbol_id(c1->marker) == 0);
     am_addterm(c1, xl, 1.0);
     am_setrelation(c1, AM_GREATEQUAL);
     ret = am_add(c1);
@@ -907,67 +870,1269 @@ void test_null()
 
     am_Solver *solver2 = am_newsolver(NULL, NULL);
     am_Constraint *c2 = am_newconstraint(solver2, AM_REQUIRED);
-    assert(c->marker.id == 0);
+    assert(am_Symbol_id(c->marker) == 0);
     assert(c->solver != c2->solver);
     ret = am_mergeconstraint(c, c2, 0.0);
     assert(ret == AM_FAILED);
 }
 
-static void BM_test_all(benchmark::State &state)
+static void run_test(benchmark::State &state, void (*test)())
 {
-    std::string x = "hello";
+    /* the tests clear maxmem when they finish, so report the peak over
+     * all iterations from peakmem instead */
+    peakmem = allmem;
     for (auto _ : state)
-        test_all();
+        test();
+    state.counters["maxmem"] = (double)peakmem;
+}
+
+static void BM_test_all(benchmark::State &state)
+{
+    run_test(state, test_all);
 }
 BENCHMARK(BM_test_all);
 
 static void BM_test_null(benchmark::State &state)
 {
-    for (auto _ : state)
-        test_null();
+    run_test(state, test_null);
 }
 BENCHMARK(BM_test_null);
 
 static void BM_test_set_strength(benchmark::State &state)
 {
-    for (auto _ : state)
-        test_set_strength();
+    run_test(state, test_set_strength);
 }
 BENCHMARK(BM_test_set_strength);
 
 static void BM_test_cycling(benchmark::State &state)
 {
-    for (auto _ : state)
-        test_cycling();
+    run_test(state, test_cycling);
 }
 BENCHMARK(BM_test_cycling);
 
 static void BM_test_suggest(benchmark::State &state)
 {
-    for (auto _ : state)
-        test_suggest();
+    run_test(state, test_suggest);
 }
 BENCHMARK(BM_test_suggest);
 
 static void BM_test_binarytree(benchmark::State &state)
 {
-    for (auto _ : state)
-        test_binarytree();
+    run_test(state, test_binarytree);
 }
 BENCHMARK(BM_test_binarytree);
 
 static void BM_test_strength(benchmark::State &state)
 {
-    for (auto _ : state)
-        test_strength();
+    run_test(state, test_strength);
 }
 BENCHMARK(BM_test_strength);
 
 static void BM_test_unbounded(benchmark::State &state)
 {
-    for (auto _ : state)
-        test_unbounded();
+    run_test(state, test_unbounded);
 }
 BENCHMARK(BM_test_unbounded);
 
+static am_Solver *new_toggle_layout(int count, int binding,
+                                    am_Constraint **group)
+{
+    /* a chain of boxes with a group of breakpoint constraints on top; a
+     * binding group moves every box, a non-binding one only limits them */
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    am_Variable *prev = NULL;
+    for (int i = 0; i < count; ++i) {
+        am_Variable *x = am_newvariable(solver);
+        if (prev)
+            new_constraint(solver, AM_REQUIRED, x, 1.0, AM_GREATEQUAL, 1.0,
+                           prev, 1.0, END);
+        else
+            new_constraint(solver, AM_REQUIRED, x, 1.0, AM_GREATEQUAL, 0.0,
+                           END);
+        new_constraint(solver, AM_WEAK, x, 1.0, AM_EQUAL, 0.0, END);
+        if (binding)
+            group[i] = new_constraint(solver, AM_STRONG, x, 1.0, AM_EQUAL,
+                                      10.0 * i, END);
+        else
+            group[i] = new_constraint(solver, AM_STRONG, x, 1.0,
+                                      AM_LESSEQUAL, 10.0 * i + 10.0, END);
+        prev = x;
+    }
+    return solver;
+}
+
+static void BM_toggle_group(benchmark::State &state)
+{
+    int count = (int)state.range(0);
+    am_Constraint **group = (am_Constraint **)malloc(count * sizeof(*group));
+    am_Solver *solver = new_toggle_layout(count, (int)state.range(1), group);
+    for (auto _ : state) {
+        am_disablegroup(group, count);
+        am_enablegroup(group, count);
+    }
+    am_delsolver(solver);
+    free(group);
+}
+BENCHMARK(BM_toggle_group)->Args({500, 0})->Args({500, 1});
+
+static void BM_toggle_group_remove(benchmark::State &state)
+{
+    int count = (int)state.range(0);
+    am_Constraint **group = (am_Constraint **)malloc(count * sizeof(*group));
+    am_Solver *solver = new_toggle_layout(count, (int)state.range(1), group);
+    for (auto _ : state) {
+        for (int i = 0; i < count; ++i)
+            am_remove(group[i]);
+        for (int i = 0; i < count; ++i)
+            am_add(group[i]);
+    }
+    am_delsolver(solver);
+    free(group);
+}
+BENCHMARK(BM_toggle_group_remove)->Args({500, 0})->Args({500, 1});
+
+static am_Solver *new_handle_layout(int count, am_Variable **handles)
+{
+    /* draggable handles kept in order, each resting at its own place;
+     * their values follow the layout, so an edit starts where the handle
+     * is rather than where it was last published */
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    am_autoupdate(solver, 1);
+    for (int i = 0; i < count; ++i) {
+        handles[i] = am_newvariable(solver);
+        new_constraint(solver, AM_WEAK, handles[i], 1.0, AM_EQUAL,
+                       20.0 * i, END);
+        if (i > 0)
+            new_constraint(solver, AM_REQUIRED, handles[i], 1.0,
+                           AM_GREATEQUAL, 5.0, handles[i - 1], 1.0, END);
+    }
+    return solver;
+}
+
+static void BM_edit_gesture(benchmark::State &state)
+{
+    int count = (int)state.range(0), i = 0;
+    am_Variable **handles = (am_Variable **)malloc(count * sizeof(*handles));
+    am_Solver *solver = new_handle_layout(count, handles);
+    for (auto _ : state) {
+        am_Variable *var = handles[i++ % count];
+        am_addedit(var, AM_STRONG);
+        am_suggest(var, am_value(var) + 3.0);
+        am_suggest(var, am_value(var) + 1.0);
+        am_deledit(var);
+    }
+    am_delsolver(solver);
+    free(handles);
+}
+BENCHMARK(BM_edit_gesture)->Arg(100)->Arg(500);
+
+static void BM_edit_gesture_suspend(benchmark::State &state)
+{
+    int count = (int)state.range(0), i = 0;
+    am_Variable **handles = (am_Variable **)malloc(count * sizeof(*handles));
+    am_Solver *solver = new_handle_layout(count, handles);
+    for (int j = 0; j < count; ++j) {
+        am_addedit(handles[j], AM_STRONG);
+        am_suspendedit(handles[j]);
+    }
+    for (auto _ : state) {
+        am_Variable *var = handles[i++ % count];
+        am_resumeedit(var);
+        am_suggest(var, am_value(var) + 3.0);
+        am_suggest(var, am_value(var) + 1.0);
+        am_suspendedit(var);
+    }
+    am_delsolver(solver);
+    free(handles);
+}
+BENCHMARK(BM_edit_gesture_suspend)->Arg(100)->Arg(500);
+
+static void report_latency(benchmark::State &state, std::vector<double> &us)
+{
+    if (us.empty())
+        return;
+    std::sort(us.begin(), us.end());
+    state.counters["p50_us"] = us[us.size() / 2];
+    state.counters["p99_us"] = us[us.size() * 99 / 100];
+    state.counters["p999_us"] = us[us.size() * 999 / 1000];
+    state.counters["max_us"] = us.back();
+}
+
+static void BM_suggest_latency(benchmark::State &state)
+{
+    /* one iteration is one frame: resume unfinished work if any, else
+     * drag a random handle to a random place */
+    const int count = 500, edits = 8;
+    unsigned budget = (unsigned)state.range(0);
+    am_Variable **handles = (am_Variable **)malloc(count * sizeof(*handles));
+    am_Solver *solver = new_handle_layout(count, handles);
+    std::vector<double> us;
+    int pending = AM_OK;
+    srand(42);
+    for (int i = 0; i < edits; ++i)
+        am_addedit(handles[i * (count / edits)], AM_STRONG);
+    am_setbudget(solver, budget);
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        if (pending == AM_INCOMPLETE)
+            pending = am_resume(solver);
+        else {
+            am_Variable *var = handles[(rand() % edits) * (count / edits)];
+            am_suggest(var, (am_Float)(rand() % (count * 20)));
+            pending = am_incomplete(solver) ? AM_INCOMPLETE : AM_OK;
+        }
+        std::chrono::duration<double, std::micro> d =
+            std::chrono::steady_clock::now() - start;
+        us.push_back(d.count());
+    }
+    report_latency(state, us);
+    am_delsolver(solver);
+    free(handles);
+}
+BENCHMARK(BM_suggest_latency)->Arg(0)->Arg(8)->Arg(32);
+
+static am_Solver *new_binarytree(int levels, int presolve)
+{
+    /* the constraints of test_binarytree, with a configurable depth */
+    int count = (1 << levels) - 1, i;
+    am_Variable **x = (am_Variable **)malloc(2 * count * sizeof(*x));
+    am_Variable **y = x + count;
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    am_presolve(solver, presolve);
+    x[0] = am_newvariable(solver);
+    y[0] = am_newvariable(solver);
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(y[0], AM_STRONG);
+    am_suggest(x[0], 500.0);
+    am_suggest(y[0], 10.0);
+    for (i = 1; i < count; ++i) {
+        int first = (1 << (31 - __builtin_clz(i + 1))) - 1;
+        x[i] = am_newvariable(solver);
+        y[i] = am_newvariable(solver);
+        new_constraint(solver, AM_REQUIRED, y[i], 1.0, AM_EQUAL, 15.0,
+                       y[first - 1], 1.0, END);
+        if (i > first)
+            new_constraint(solver, AM_REQUIRED, x[i], 1.0, AM_GREATEQUAL, 5.0,
+                           x[i - 1], 1.0, END);
+        else
+            new_constraint(solver, AM_REQUIRED, x[i], 1.0, AM_GREATEQUAL, 0.0,
+                           END);
+        if ((i - first) % 2 == 1)
+            new_constraint(solver, AM_REQUIRED, x[(i - 1) / 2], 1.0, AM_EQUAL,
+                           0.0, x[i], 0.5, x[i - 1], 0.5, END);
+    }
+    free(x);
+    return solver;
+}
+
+static void BM_binarytree_presolve(benchmark::State &state)
+{
+    size_t rows = 0;
+    for (auto _ : state) {
+        am_Solver *solver = new_binarytree((int)state.range(0),
+                                           (int)state.range(1));
+        rows = solver->rows.count;
+        am_delsolver(solver);
+    }
+    state.counters["rows"] = (double)rows;
+}
+BENCHMARK(BM_binarytree_presolve)->Args({12, 0})->Args({12, 1});
+
+static void BM_presolve_remove(benchmark::State &state)
+{
+    /* removing a presolved equality rebuilds the whole tableau */
+    am_Solver *solver = new_binarytree((int)state.range(0),
+                                       (int)state.range(1));
+    am_Variable *a = am_newvariable(solver);
+    am_Variable *b = am_newvariable(solver);
+    am_Constraint *c = new_constraint(solver, AM_REQUIRED, a, 1.0, AM_EQUAL,
+                                      10.0, b, 1.0, END);
+    for (auto _ : state) {
+        am_remove(c);
+        am_add(c);
+    }
+    state.counters["rows"] = (double)solver->rows.count;
+    am_delsolver(solver);
+}
+BENCHMARK(BM_presolve_remove)->Args({10, 0})->Args({10, 1});
+
+static am_Solver *new_bounded_layout(int count, int native, am_Variable **first)
+{
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    am_Variable *prev = NULL;
+    int i;
+    for (i = 0; i < count; ++i) {
+        am_Variable *x = am_newvariable(solver);
+        if (native)
+            am_setbounds(x, 0.0, 10.0 * count, AM_REQUIRED);
+        else {
+            new_constraint(solver, AM_REQUIRED, x, 1.0, AM_GREATEQUAL, 0.0,
+                           END);
+            new_constraint(solver, AM_REQUIRED, x, 1.0, AM_LESSEQUAL,
+                           10.0 * count, END);
+        }
+        new_constraint(solver, AM_WEAK, x, 1.0, AM_EQUAL, 10.0 * i, END);
+        if (prev)
+            new_constraint(solver, AM_REQUIRED, x, 1.0, AM_GREATEQUAL, 5.0,
+                           prev, 1.0, END);
+        else
+            *first = x;
+        prev = x;
+    }
+    am_addedit(*first, AM_STRONG);
+    return solver;
+}
+
+static void BM_bounded_layout(benchmark::State &state)
+{
+    int count = (int)state.range(0), i = 0;
+    am_Variable *first = NULL;
+    am_Solver *solver = new_bounded_layout(count, (int)state.range(1), &first);
+    for (auto _ : state)
+        am_suggest(first, (am_Float)((i++ % 2) ? 0 : 10 * count));
+    state.counters["rows"] = (double)solver->rows.count;
+    am_delsolver(solver);
+}
+BENCHMARK(BM_bounded_layout)->Args({200, 0})->Args({200, 1});
+
+static am_Constraint *make_constraint(am_Solver *solver, double strength,
+                                      am_Variable *x, int relation,
+                                      double constant, am_Variable *y)
+{
+    am_Constraint *c = am_newconstraint(solver, (am_Float)strength);
+    am_addterm(c, x, 1.0);
+    am_setrelation(c, relation);
+    am_addconstant(c, (am_Float)constant);
+    if (y)
+        am_addterm(c, y, 1.0);
+    return c;
+}
+
+static void BM_document_open(benchmark::State &state)
+{
+    /* a flow of boxes: about four constraints per variable */
+    int count = (int)state.range(0), bulk = (int)state.range(1);
+    std::vector<am_Variable *> x(count / 4 + 2);
+    std::vector<am_Constraint *> cons;
+    for (auto _ : state) {
+        am_Solver *solver = am_newsolver(NULL, NULL);
+        size_t i;
+        cons.clear();
+        for (i = 0; cons.size() < (size_t)count; ++i) {
+            x[i] = am_newvariable(solver);
+            cons.push_back(make_constraint(solver, AM_REQUIRED, x[i],
+                                           AM_GREATEQUAL, 0.0, NULL));
+            cons.push_back(make_constraint(solver, AM_WEAK, x[i], AM_EQUAL,
+                                           10.0 * i, NULL));
+            if (i > 0)
+                cons.push_back(make_constraint(solver, AM_REQUIRED, x[i],
+                                               AM_GREATEQUAL, 5.0, x[i - 1]));
+            if (i > 1)
+                cons.push_back(make_constraint(solver, AM_MEDIUM, x[i],
+                                               AM_LESSEQUAL, 25.0, x[i - 2]));
+        }
+        if (bulk)
+            am_addgroup(cons.data(), cons.size());
+        else
+            for (i = 0; i < cons.size(); ++i)
+                am_add(cons[i]);
+        am_updatevars(solver);
+        am_delsolver(solver);
+    }
+    state.counters["constraints"] = (double)cons.size();
+}
+BENCHMARK(BM_document_open)
+    ->Args({1000, 0})->Args({1000, 1})
+    ->Args({10000, 0})->Args({10000, 1})
+    ->Args({100000, 0})->Args({100000, 1})
+    ->Unit(benchmark::kMillisecond);
+
+static am_Constraint *grid_constraint(am_Solver *solver, double strength,
+                                      int relation, double constant,
+                                      am_Variable *a, am_Variable *b,
+                                      am_Variable *c)
+{
+    /* a == b + c + constant, with b and c optional */
+    am_Constraint *cons = am_newconstraint(solver, (am_Float)strength);
+    am_addterm(cons, a, 1.0);
+    am_setrelation(cons, relation);
+    am_addconstant(cons, (am_Float)constant);
+    if (b)
+        am_addterm(cons, b, 1.0);
+    if (c)
+        am_addterm(cons, c, 1.0);
+    return cons;
+}
+
+static void BM_grid_layout(benchmark::State &state)
+{
+    /* rows of boxes with left/width/right, gaps, column alignment and a
+     * page width, added in a shuffled order so that rows often come in
+     * with several variables the tableau has not solved for yet */
+    int rows = (int)state.range(0), cols = (int)state.range(1);
+    size_t nonzeros = 0;
+    for (auto _ : state) {
+        am_Solver *solver = am_newsolver(NULL, NULL);
+        std::vector<am_Variable *> l, w, r;
+        std::vector<am_Constraint *> cons;
+        am_Row *row = NULL;
+        int i, j, k = 0;
+        for (i = 0; i < rows; ++i) {
+            for (j = 0; j < cols; ++j) {
+                k = i * cols + j;
+                l.push_back(am_newvariable(solver));
+                w.push_back(am_newvariable(solver));
+                r.push_back(am_newvariable(solver));
+                cons.push_back(grid_constraint(solver, AM_REQUIRED, AM_EQUAL,
+                                               0.0, r[k], l[k], w[k]));
+                cons.push_back(grid_constraint(solver, AM_REQUIRED,
+                                               AM_GREATEQUAL, 10.0, w[k],
+                                               NULL, NULL));
+                cons.push_back(grid_constraint(solver, AM_WEAK, AM_EQUAL,
+                                               50.0 + k % 7, w[k], NULL,
+                                               NULL));
+                cons.push_back(grid_constraint(solver, AM_REQUIRED,
+                                               AM_GREATEQUAL, j ? 5.0 : 0.0,
+                                               l[k], j ? r[k - 1] : NULL,
+                                               NULL));
+                if (i > 0)
+                    cons.push_back(grid_constraint(solver, AM_MEDIUM,
+                                                   AM_EQUAL, 0.0, l[k],
+                                                   l[k - cols], NULL));
+            }
+            cons.push_back(grid_constraint(solver, AM_REQUIRED, AM_LESSEQUAL,
+                                           800.0, r[k], NULL, NULL));
+        }
+        srand(1);
+        for (i = (int)cons.size() - 1; i > 0; --i)
+            std::swap(cons[i], cons[rand() % (i + 1)]);
+        for (i = 0; i < (int)cons.size(); ++i)
+            am_add(cons[i]);
+        nonzeros = 0;
+        while (am_nextentry(&solver->rows, (am_Entry **)&row))
+            nonzeros += row->terms.count;
+        am_delsolver(solver);
+    }
+    state.counters["nonzeros"] = (double)nonzeros;
+}
+BENCHMARK(BM_grid_layout)->Args({10, 10})->Args({20, 10})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_soak(benchmark::State &state)
+{
+    /* a long-lived solver: edits and constraints coming and going, with
+     * refactoring every range(1) pivots (0 for never) */
+    int count = (int)state.range(0), i, k;
+    std::vector<am_Variable *> x(count);
+    std::vector<am_Constraint *> extra(count);
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    size_t nonzeros = 0, slots = 0;
+    am_Row *row = NULL;
+    am_autorefactor(solver, (unsigned)state.range(1));
+    for (i = 0; i < count; ++i) {
+        x[i] = am_newvariable(solver);
+        am_add(make_constraint(solver, AM_REQUIRED, x[i], AM_GREATEQUAL, 0.0,
+                               NULL));
+        am_add(make_constraint(solver, AM_WEAK, x[i], AM_EQUAL, 10.0 * i,
+                               NULL));
+        if (i > 0)
+            am_add(make_constraint(solver, AM_REQUIRED, x[i], AM_GREATEQUAL,
+                                   5.0, x[i - 1]));
+        if (i > 1)
+            am_add(make_constraint(solver, AM_MEDIUM, x[i], AM_LESSEQUAL,
+                                   25.0, x[i - 2]));
+    }
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(x[count / 2], AM_STRONG);
+    srand(1);
+    for (auto _ : state) {
+        for (i = 0; i < 1000; ++i) {
+            k = rand() % count;
+            if (i % 10 != 0)
+                am_suggest(x[i % 2 ? 0 : count / 2], (rand() % 10000) * 0.731);
+            else if (extra[k] != NULL) {
+                am_delconstraint(extra[k]);
+                extra[k] = NULL;
+            }
+            else if (k > 3) {
+                extra[k] = make_constraint(solver, AM_STRONG, x[k],
+                                           AM_LESSEQUAL, 3.0 + rand() % 50,
+                                           x[k - 3]);
+                am_add(extra[k]);
+            }
+        }
+    }
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        nonzeros += row->terms.count, slots += row->terms.size;
+    state.counters["nonzeros"] = (double)nonzeros;
+    state.counters["slots"] = (double)slots;
+    am_delsolver(solver);
+}
+BENCHMARK(BM_soak)->Args({100, 0})->Args({100, 2000})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_column_index(benchmark::State &state)
+{
+    /* the document flow added one constraint at a time, with and without
+     * the column index, followed by a few drags of its first box */
+    int count = (int)state.range(0), i;
+    std::vector<am_Variable *> x(count);
+    for (auto _ : state) {
+        am_Solver *solver = am_newsolver(NULL, NULL);
+        am_columnindex(solver, (int)state.range(1));
+        for (i = 0; i < count; ++i) {
+            x[i] = am_newvariable(solver);
+            am_add(make_constraint(solver, AM_REQUIRED, x[i], AM_GREATEQUAL,
+                                   0.0, NULL));
+            am_add(make_constraint(solver, AM_WEAK, x[i], AM_EQUAL, 10.0 * i,
+                                   NULL));
+            if (i > 0)
+                am_add(make_constraint(solver, AM_REQUIRED, x[i],
+                                       AM_GREATEQUAL, 5.0, x[i - 1]));
+            if (i > 1)
+                am_add(make_constraint(solver, AM_MEDIUM, x[i], AM_LESSEQUAL,
+                                       25.0, x[i - 2]));
+        }
+        am_addedit(x[0], AM_STRONG);
+        for (i = 0; i < 10; ++i)
+            am_suggest(x[0], 40.0 * i);
+        am_updatevars(solver);
+        am_delsolver(solver);
+    }
+}
+BENCHMARK(BM_column_index)
+    ->Args({500, 0})->Args({500, 1})
+    ->Args({2000, 0})->Args({2000, 1})
+    ->Unit(benchmark::kMillisecond);
+
+static void count_piece(void *ud, am_Float from, am_Float to,
+                        const am_Float *values, const am_Float *slopes)
+{
+    (void)from, (void)to, (void)values, (void)slopes;
+    ++*(int *)ud;
+}
+
+static am_Variable *new_box_row(am_Solver *solver,
+                                std::vector<am_Variable *> &w)
+{
+    /* boxes with preferred widths side by side on a page, returns the
+     * page width */
+    am_Variable *page = am_newvariable(solver), *prev = NULL;
+    int i;
+    for (i = 0; i < (int)w.size(); ++i) {
+        am_Variable *l = am_newvariable(solver), *r = am_newvariable(solver);
+        am_Constraint *c = am_newconstraint(solver, AM_REQUIRED);
+        w[i] = am_newvariable(solver);
+        am_addterm(c, r, 1.0);
+        am_setrelation(c, AM_EQUAL);
+        am_addterm(c, l, 1.0);
+        am_addterm(c, w[i], 1.0);
+        am_add(c);
+        am_add(make_constraint(solver, AM_REQUIRED, w[i], AM_GREATEQUAL, 20.0,
+                               NULL));
+        am_add(make_constraint(solver, AM_WEAK * (1 + i % 5), w[i], AM_EQUAL,
+                               60.0 + (i * 37) % 200, NULL));
+        am_add(make_constraint(solver, AM_REQUIRED, l, AM_GREATEQUAL,
+                               prev ? 8.0 : 0.0, prev));
+        prev = r;
+    }
+    am_add(make_constraint(solver, AM_REQUIRED, prev, AM_LESSEQUAL, 0.0, page));
+    return page;
+}
+
+static void BM_width_sweep(benchmark::State &state)
+{
+    /* a row of boxes evaluated at every page width from 320 to 2560: one
+     * suggest per width, or one am_sweep */
+    int count = (int)state.range(0), pieces = 0, i, width;
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    std::vector<am_Variable *> w(count);
+    am_Variable *page = new_box_row(solver, w);
+    am_addedit(page, AM_STRONG);
+    for (auto _ : state) {
+        pieces = 0;
+        if (state.range(1))
+            am_sweep(page, 320.0, 2560.0, w.data(), w.size(), count_piece,
+                     &pieces);
+        else
+            for (width = 320; width <= 2560; ++width) {
+                am_suggest(page, width);
+                am_updatevars(solver);
+                for (i = 0; i < count; ++i)
+                    benchmark::DoNotOptimize(am_value(w[i]));
+            }
+    }
+    state.counters["pieces"] = (double)pieces;
+    am_delsolver(solver);
+}
+BENCHMARK(BM_width_sweep)->Args({10, 0})->Args({10, 1})
+    ->Args({40, 0})->Args({40, 1});
+
+static void BM_memo_toggle(benchmark::State &state)
+{
+    /* switching between four window sizes, with range(1) states memoized */
+    static const double widths[] = { 400.0, 1200.0, 2000.0, 800.0 };
+    int count = (int)state.range(0), k = 0;
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    std::vector<am_Variable *> w(count);
+    am_Variable *page = new_box_row(solver, w);
+    size_t hits = 0, misses = 0;
+    am_memoize(solver, (unsigned)state.range(1));
+    am_addedit(page, AM_STRONG);
+    for (auto _ : state) {
+        am_suggest(page, widths[k++ % 4]);
+        am_updatevars(solver);
+    }
+    am_memostats(solver, &hits, &misses);
+    state.counters["hits"] = (double)hits;
+    state.counters["misses"] = (double)misses;
+    am_delsolver(solver);
+}
+BENCHMARK(BM_memo_toggle)->Args({20, 0})->Args({20, 8})
+    ->Args({40, 0})->Args({40, 8});
+
+static void BM_drag_nopivot(benchmark::State &state)
+{
+    /* a chain that follows its first box: small drags never change the
+     * basis, so each suggest only moves the rows of the edit's column */
+    int count = (int)state.range(0), i, k = 0;
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    std::vector<am_Variable *> x(count);
+    for (i = 0; i < count; ++i) {
+        x[i] = am_newvariable(solver);
+        am_add(make_constraint(solver, AM_WEAK, x[i], AM_EQUAL,
+                               1000.0 + 10.0 * i, NULL));
+        if (i > 0) {
+            am_Constraint *c = make_constraint(solver, AM_REQUIRED, x[i],
+                                               AM_EQUAL, 10.0, NULL);
+            am_addterm(c, x[i - 1], -1.0);
+            am_add(c);
+        }
+    }
+    am_addedit(x[0], AM_STRONG);
+    am_suggest(x[0], 500.0);
+    for (auto _ : state) {
+        am_suggest(x[0], 500.0 + (k++ % 100) * 0.5);
+        am_updatevars(solver);
+    }
+    am_delsolver(solver);
+}
+BENCHMARK(BM_drag_nopivot)->Arg(100)->Arg(300);
+
+static void BM_freeze_drag(benchmark::State &state)
+{
+    /* dragging the last box of a long flow, with all but the last 20
+     * boxes frozen when range(1) is set */
+    int count = (int)state.range(0), i, k = 0;
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    std::vector<am_Variable *> x(count);
+    for (i = 0; i < count; ++i) {
+        x[i] = am_newvariable(solver);
+        am_add(make_constraint(solver, AM_REQUIRED, x[i], AM_GREATEQUAL, 0.0,
+                               NULL));
+        am_add(make_constraint(solver, AM_WEAK, x[i], AM_EQUAL, 10.0 * i,
+                               NULL));
+        if (i > 0)
+            am_add(make_constraint(solver, AM_REQUIRED, x[i], AM_GREATEQUAL,
+                                   5.0, x[i - 1]));
+        if (i > 1)
+            am_add(make_constraint(solver, AM_MEDIUM, x[i], AM_LESSEQUAL,
+                                   25.0, x[i - 2]));
+    }
+    if (state.range(1))
+        am_freeze(x.data(), count - 20);
+    am_addedit(x[count - 1], AM_STRONG);
+    for (auto _ : state) {
+        am_suggest(x[count - 1], 10.0 * count + (k++ % 50) * 7.0);
+        am_updatevars(solver);
+    }
+    state.counters["rows"] = (double)solver->rows.count;
+    am_delsolver(solver);
+}
+BENCHMARK(BM_freeze_drag)->Args({2000, 0})->Args({2000, 1});
+
+static void BM_difference_layout(benchmark::State &state)
+{
+    /* loading range(0) boxes spaced out in a chain, or in a binary tree
+     * when range(1) is set, through the difference graph if range(2) */
+    int count = (int)state.range(0), tree = (int)state.range(1), i;
+    std::vector<am_Variable *> x(count);
+    for (auto _ : state) {
+        am_Solver *solver = am_newsolver(NULL, NULL);
+        am_diffsolve(solver, (int)state.range(2));
+        for (i = 0; i < count; ++i) {
+            x[i] = am_newvariable(solver);
+            if (i > 0)
+                am_add(make_constraint(solver, AM_REQUIRED, x[i],
+                                       AM_GREATEQUAL, 10.0,
+                                       x[tree ? (i - 1) / 2 : i - 1]));
+        }
+        am_updatevars(solver);
+        benchmark::DoNotOptimize(am_value(x[count - 1]));
+        am_delsolver(solver);
+    }
+}
+BENCHMARK(BM_difference_layout)
+    ->Args({2000, 0, 0})->Args({2000, 0, 1})->Args({100000, 0, 1})
+    ->Args({2000, 1, 0})->Args({2000, 1, 1})->Args({100000, 1, 1})
+    ->Unit(benchmark::kMillisecond);
+
+static void add_component(am_Solver *solver, am_Variable *left,
+                          am_Variable *width)
+{
+    /* eight boxes spaced out inside [left, left + width] */
+    am_Variable *prev = left;
+    int i;
+    for (i = 0; i < 8; ++i) {
+        am_Variable *x = am_newvariable(solver);
+        am_Constraint *c = make_constraint(solver, AM_WEAK, x, AM_EQUAL,
+                                           12.0 * i, left);
+        am_add(c);
+        am_add(make_constraint(solver, AM_REQUIRED, x, AM_GREATEQUAL,
+                               i ? 4.0 : 2.0, prev));
+        c = make_constraint(solver, AM_REQUIRED, x, AM_LESSEQUAL, -2.0, left);
+        am_addterm(c, width, 1.0);
+        am_add(c);
+        am_delvariable(x);
+        prev = x;
+    }
+}
+
+static void BM_nested_components(benchmark::State &state)
+{
+    /* rows of ten components in one solver, or each component in a child
+     * solver bound to its slot when range(1) is set; dragging the first
+     * width of a row moves that row only */
+    int count = (int)state.range(0), nested = (int)state.range(1), i, k = 0;
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    std::vector<am_Variable *> left(count), width(count);
+    std::vector<am_Solver *> children;
+    for (i = 0; i < count; ++i) {
+        left[i] = am_newvariable(solver);
+        width[i] = am_newvariable(solver);
+        am_add(make_constraint(solver, AM_REQUIRED, width[i], AM_GREATEQUAL,
+                               50.0, NULL));
+        am_add(make_constraint(solver, AM_WEAK, width[i], AM_EQUAL, 100.0,
+                               NULL));
+        if (i % 10 == 0)
+            am_add(make_constraint(solver, AM_REQUIRED, left[i], AM_EQUAL,
+                                   0.0, NULL));
+        else {
+            am_Constraint *c = make_constraint(solver, AM_REQUIRED, left[i],
+                                               AM_EQUAL, 0.0, left[i - 1]);
+            am_addterm(c, width[i - 1], -1.0);
+            am_add(c);
+        }
+        if (nested) {
+            am_Solver *child = am_newsolver(NULL, NULL);
+            am_Variable *l = am_newvariable(child);
+            am_Variable *w = am_newvariable(child);
+            am_bind(l, left[i], AM_STRONG);
+            am_bind(w, width[i], AM_STRONG);
+            add_component(child, l, w);
+            children.push_back(child);
+        }
+        else
+            add_component(solver, left[i], width[i]);
+    }
+    for (i = 0; i < count; i += 10)
+        am_addedit(width[i], AM_STRONG);
+    for (auto _ : state) {
+        i = (k * 10) % count;
+        am_suggest(width[i], (k++ / (count / 10)) % 2 ? 150.0 : 60.0);
+        am_updatevars(solver);
+        for (am_Solver *child : children)
+            am_updatevars(child);
+    }
+    for (am_Solver *child : children)
+        am_delsolver(child);
+    am_delsolver(solver);
+}
+/* flat about 2.8 ms per drag, nested about 0.12 ms (1000 components,
+ * -O3, Google Benchmark 1.7.1) */
+BENCHMARK(BM_nested_components)->Args({1000, 0})->Args({1000, 1});
+
+static void count_events(void *ud, const am_TraceEvent *ev)
+{
+    ++*(size_t *)ud;
+    (void)ev;
+}
+
+static void BM_trace_drag(benchmark::State &state)
+{
+    /* a chain of range(0) boxes pushed back and forth so that every drag
+     * pivots; range(1) is 0 with no hook, 1 counting events, 2 writing a
+     * Chrome trace to the null device */
+    int count = (int)state.range(0), i, k = 0;
+    am_Solver *solver = am_newsolver(NULL, NULL);
+    std::vector<am_Variable *> x(count);
+    size_t events = 0;
+    for (i = 0; i < count; ++i) {
+        x[i] = am_newvariable(solver);
+        am_add(make_constraint(solver, AM_WEAK, x[i], AM_EQUAL, 30.0 * i,
+                               NULL));
+        if (i > 0)
+            am_add(make_constraint(solver, AM_REQUIRED, x[i], AM_GREATEQUAL,
+                                   10.0, x[i - 1]));
+    }
+    am_addedit(x[0], AM_STRONG);
+    if (state.range(1) == 1)
+        am_settrace(solver, count_events, &events);
+    else if (state.range(1) == 2)
+        am_tracefile(solver, "/dev/null");
+    for (auto _ : state) {
+        am_suggest(x[0], (k++ & 1) ? 20.0 * count : 0.0);
+        am_updatevars(solver);
+    }
+    state.counters["events"] = (double)events / state.iterations();
+    am_delsolver(solver);
+}
+BENCHMARK(BM_trace_drag)->Args({200, 0})->Args({200, 1})->Args({200, 2});
+
+static void BM_replay(benchmark::State &state)
+{
+    /* replays the recording named by AM_REPLAY, see replay.c for the time
+     * taken by each kind of call */
+    const char *path = getenv("AM_REPLAY");
+    if (path == NULL) {
+        state.SkipWithError("set AM_REPLAY to a recording");
+        return;
+    }
+    for (auto _ : state) {
+        am_Solver *solver = am_newsolver(NULL, NULL);
+        if (am_replay(solver, path, NULL, NULL) != AM_OK)
+            state.SkipWithError("cannot replay AM_REPLAY");
+        am_delsolver(solver);
+    }
+}
+BENCHMARK(BM_replay)->Unit(benchmark::kMillisecond);
+
+/* Synthetic workloads that grow with their arguments, for tracking how each
+ * solver change scales.  A generator creates its variables and constraints
+ * without adding them and picks a handle for the suggest benchmarks; the
+ * same three measurements run over every generator. */
+struct Workload {
+    am_Solver *solver;
+    std::vector<am_Variable *> vars;
+    std::vector<am_Constraint *> cons;
+    am_Variable *handle;
+};
+
+typedef void Generator(Workload &w, benchmark::State &state);
+
+static am_Variable *workload_var(Workload &w)
+{
+    w.vars.push_back(am_newvariable(w.solver));
+    return w.vars.back();
+}
+
+static void workload_cons(Workload &w, double strength, int relation,
+                          double constant, am_Variable *a, am_Variable *b,
+                          am_Variable *c)
+{
+    w.cons.push_back(grid_constraint(w.solver, strength, relation, constant,
+                                     a, b, c));
+}
+
+static void gen_grid(Workload &w, benchmark::State &state)
+{
+    /* range(0) rows of range(1) boxes as in BM_grid_layout, with the page
+     * width as the handle */
+    int rows = (int)state.range(0), cols = (int)state.range(1), i, j;
+    std::vector<am_Variable *> l, r;
+    am_Variable *page = workload_var(w);
+    workload_cons(w, AM_WEAK, AM_EQUAL, 800.0, page, NULL, NULL);
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < cols; ++j) {
+            int k = i * cols + j;
+            am_Variable *width = workload_var(w);
+            l.push_back(workload_var(w));
+            r.push_back(workload_var(w));
+            workload_cons(w, AM_REQUIRED, AM_EQUAL, 0.0, r[k], l[k], width);
+            workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, 10.0, width, NULL,
+                          NULL);
+            workload_cons(w, AM_WEAK, AM_EQUAL, 50.0 + k % 7, width, NULL,
+                          NULL);
+            workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, j ? 5.0 : 0.0, l[k],
+                          j ? r[k - 1] : NULL, NULL);
+            if (i > 0)
+                workload_cons(w, AM_MEDIUM, AM_EQUAL, 0.0, l[k], l[k - cols],
+                              NULL);
+        }
+        workload_cons(w, AM_STRONG, AM_LESSEQUAL, 0.0, r.back(), page, NULL);
+    }
+    w.handle = page;
+}
+
+static void gen_chain(Workload &w, benchmark::State &state)
+{
+    /* range(0) boxes each pushed by the one before it, dragged from the
+     * head so that a move ripples down the whole chain */
+    int count = (int)state.range(0), i;
+    for (i = 0; i < count; ++i) {
+        workload_var(w);
+        workload_cons(w, AM_WEAK, AM_EQUAL, 20.0 * i, w.vars[i], NULL, NULL);
+        if (i > 0) {
+            workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, 10.0, w.vars[i],
+                          w.vars[i - 1], NULL);
+            workload_cons(w, AM_MEDIUM, AM_LESSEQUAL, 30.0, w.vars[i],
+                          w.vars[i - 1], NULL);
+        }
+    }
+    w.handle = w.vars[0];
+}
+
+static void gen_tree(Workload &w, benchmark::State &state)
+{
+    /* a binary tree of depth range(0) laid out like new_binarytree: every
+     * parent centred over its children, one level below the other */
+    int count = (1 << state.range(0)) - 1, i;
+    std::vector<am_Variable *> x(count), y(count);
+    for (i = 0; i < count; ++i) {
+        int parent = (i - 1) / 2;
+        x[i] = workload_var(w);
+        y[i] = workload_var(w);
+        if (i == 0) {
+            workload_cons(w, AM_WEAK, AM_EQUAL, 10.0, y[0], NULL, NULL);
+            continue;
+        }
+        workload_cons(w, AM_REQUIRED, AM_EQUAL, 15.0, y[i], y[parent], NULL);
+        if ((i & (i + 1)) == 0)
+            workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, 0.0, x[i], NULL,
+                          NULL);
+        else
+            workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, 5.0, x[i], x[i - 1],
+                          NULL);
+        if (i % 2 == 0) {
+            am_Constraint *c = am_newconstraint(w.solver, AM_REQUIRED);
+            am_addterm(c, x[parent], 1.0);
+            am_setrelation(c, AM_EQUAL);
+            am_addterm(c, x[i - 1], 0.5);
+            am_addterm(c, x[i], 0.5);
+            w.cons.push_back(c);
+        }
+    }
+    w.handle = x[0];
+}
+
+static void gen_random(Workload &w, benchmark::State &state)
+{
+    /* range(0) variables and range(1) constraints per variable, each
+     * keeping a variable within a random distance of one of the eight
+     * before it; range(2) percent are required and the rest are spread
+     * over strong, medium and weak.  Every constraint holds at a random
+     * reference point so the required ones stay satisfiable.  Links reach
+     * only a few variables back: wider ones fill the tableau in and drive
+     * the solver into its tolerances rather than measure it */
+    static const double strengths[] = { AM_STRONG, AM_MEDIUM, AM_WEAK };
+    static const int relations[] = { AM_LESSEQUAL, AM_EQUAL, AM_GREATEQUAL };
+    int count = (int)state.range(0), density = (int)state.range(1);
+    int required = (int)state.range(2), i;
+    std::vector<double> ref(count);
+    srand((unsigned)count);
+    for (i = 0; i < count; ++i) {
+        workload_var(w);
+        ref[i] = rand() % 1000;
+    }
+    for (i = 0; i < density * count; ++i) {
+        int a = i / density, b = (a + count - 1 - rand() % 8) % count;
+        int relation = relations[rand() % 3];
+        double strength = rand() % 100 < required ? AM_REQUIRED
+                                                  : strengths[rand() % 3];
+        double constant = ref[a] - ref[b];
+        if (relation != AM_EQUAL)
+            constant += (relation == AM_LESSEQUAL ? 1 : -1) * (rand() % 50);
+        workload_cons(w, strength, relation, constant, w.vars[a], w.vars[b],
+                      NULL);
+    }
+    w.handle = w.vars[0];
+}
+
+static void gen_flex(Workload &w, benchmark::State &state)
+{
+    /* a column of range(0) rows with range(1) items each: items grow from
+     * their basis to fill the container width and stretch to the row
+     * height; the container width is the handle */
+    int rows = (int)state.range(0), items = (int)state.range(1), i, j;
+    am_Variable *width = workload_var(w), *prev_y = NULL, *prev_h = NULL;
+    workload_cons(w, AM_WEAK, AM_EQUAL, 1000.0, width, NULL, NULL);
+    for (i = 0; i < rows; ++i) {
+        am_Variable *row_y = workload_var(w), *row_h = workload_var(w);
+        am_Variable *first_w = NULL, *prev_x = NULL, *prev_w = NULL;
+        workload_cons(w, AM_REQUIRED, AM_EQUAL, i ? 8.0 : 0.0, row_y, prev_y,
+                      prev_h);
+        workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, 20.0, row_h, NULL, NULL);
+        for (j = 0; j < items; ++j) {
+            am_Variable *x = workload_var(w), *item_w = workload_var(w);
+            am_Variable *h = workload_var(w);
+            workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, j ? 4.0 : 0.0, x,
+                          prev_x, prev_w);
+            workload_cons(w, AM_REQUIRED, AM_GREATEQUAL, 16.0, item_w, NULL,
+                          NULL);
+            workload_cons(w, AM_WEAK, AM_EQUAL, 40.0 + (i + j) % 5 * 10,
+                          item_w, NULL, NULL);
+            if (first_w)
+                workload_cons(w, AM_MEDIUM, AM_EQUAL, 0.0, item_w, first_w,
+                              NULL);
+            workload_cons(w, AM_REQUIRED, AM_LESSEQUAL, 0.0, h, row_h, NULL);
+            workload_cons(w, AM_MEDIUM, AM_EQUAL, 0.0, h, row_h, NULL);
+            workload_cons(w, AM_WEAK, AM_EQUAL, 20.0 + j % 3 * 10, h, NULL,
+                          NULL);
+            if (j == 0)
+                first_w = item_w;
+            prev_x = x, prev_w = item_w;
+        }
+        am_Constraint *fill = am_newconstraint(w.solver, AM_STRONG);
+        am_addterm(fill, prev_x, 1.0);
+        am_addterm(fill, prev_w, 1.0);
+        am_setrelation(fill, AM_EQUAL);
+        am_addterm(fill, width, 1.0);
+        w.cons.push_back(fill);
+        prev_y = row_y, prev_h = row_h;
+    }
+    w.handle = width;
+}
+
+static void load_workload(Workload &w, Generator *gen,
+                          benchmark::State &state)
+{
+    size_t i;
+    w.solver = am_newsolver(debug_allocf, NULL);
+    w.vars.clear();
+    w.cons.clear();
+    gen(w, state);
+    for (i = 0; i < w.cons.size(); ++i)
+        am_add(w.cons[i]);
+    am_updatevars(w.solver);
+}
+
+static void workload_counters(benchmark::State &state, Workload &w)
+{
+    state.counters["constraints"] = (double)w.cons.size();
+    state.counters["rows"] = (double)w.solver->rows.count;
+    state.SetComplexityN((int64_t)w.cons.size());
+}
+
+static void BM_workload_load(benchmark::State &state, Generator *gen)
+{
+    /* building and solving the whole system from an empty solver; bytes
+     * is what the solver keeps afterwards and maxmem the high water mark
+     * on the way there */
+    Workload w;
+    size_t bytes = 0, peak = 0;
+    for (auto _ : state) {
+        size_t base = allmem;
+        maxmem = allmem;
+        load_workload(w, gen, state);
+        bytes = allmem - base, peak = maxmem - base;
+        state.PauseTiming();
+        workload_counters(state, w);
+        am_delsolver(w.solver);
+        state.ResumeTiming();
+    }
+    state.counters["bytes"] = (double)bytes;
+    state.counters["maxmem"] = (double)peak;
+}
+
+static void BM_workload_suggest(benchmark::State &state, Generator *gen)
+{
+    /* one suggest of the handle to a random place, variables updated */
+    Workload w;
+    std::vector<double> us;
+    load_workload(w, gen, state);
+    workload_counters(state, w);
+    am_addedit(w.handle, AM_STRONG);
+    srand(42);
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        am_suggest(w.handle, (am_Float)(rand() % 2000));
+        am_updatevars(w.solver);
+        std::chrono::duration<double, std::micro> d =
+            std::chrono::steady_clock::now() - start;
+        us.push_back(d.count());
+    }
+    report_latency(state, us);
+    am_delsolver(w.solver);
+}
+
+static void BM_workload_cycle(benchmark::State &state, Generator *gen)
+{
+    /* removing one constraint and adding it back, going round all of them
+     * so that every kind of row gets its turn */
+    Workload w;
+    size_t k = 0;
+    load_workload(w, gen, state);
+    workload_counters(state, w);
+    for (auto _ : state) {
+        am_Constraint *c = w.cons[k++ % w.cons.size()];
+        am_remove(c);
+        am_add(c);
+    }
+    am_delsolver(w.solver);
+}
+
+/* Where the bytes of a loaded workload go.  Pools are counted by their
+ * pages, tables by their slots; for every table load is the share of
+ * slots in use and wasted the slots left empty.  Row terms covers the
+ * objective and every row, expressions the terms of the constraints
+ * themselves, and other whatever the rest (edits, bounds, indexes) hold. */
+struct Footprint {
+    size_t bytes, slots, used;
+};
+
+static size_t pool_bytes(const am_MemPool *pool)
+{
+    const size_t offset = AM_POOLSIZE - sizeof(void *);
+    size_t bytes = 0;
+    void *page;
+    for (page = pool->pages; page != NULL;
+         page = *(void **)((char *)page + offset))
+        bytes += AM_POOLSIZE;
+    return bytes;
+}
+
+static void add_table(Footprint &f, const am_Table *t)
+{
+    f.bytes += t->size * t->entry_size;
+    f.slots += t->size;
+    f.used += t->count;
+}
+
+static void footprint_counters(benchmark::State &state, const char *name,
+                               const Footprint &f)
+{
+    std::string n(name);
+    state.counters[n] = (double)f.bytes;
+    state.counters[n + "_load"] = f.slots ? (double)f.used / f.slots : 0.0;
+    state.counters[n + "_wasted"] = (double)(f.slots - f.used);
+}
+
+static void BM_workload_footprint(benchmark::State &state, Generator *gen)
+{
+    Workload w;
+    Footprint vars = {}, constraints = {}, rows = {}, terms = {}, exprs = {};
+    size_t bytes = 0, varpool = 0, conspool = 0, known;
+    am_Row *row = NULL;
+    am_ConsEntry *ce = NULL;
+    for (auto _ : state) {
+        size_t base = allmem;
+        load_workload(w, gen, state);
+        bytes = allmem - base;
+        state.PauseTiming();
+        workload_counters(state, w);
+        am_delsolver(w.solver);
+        state.ResumeTiming();
+    }
+
+    load_workload(w, gen, state);
+    varpool = pool_bytes(&w.solver->varpool);
+    conspool = pool_bytes(&w.solver->conspool);
+    add_table(vars, &w.solver->vars);
+    add_table(constraints, &w.solver->constraints);
+    add_table(rows, &w.solver->rows);
+    add_table(terms, &w.solver->objective.terms);
+    while (am_nextentry(&w.solver->rows, (am_Entry **)&row))
+        add_table(terms, &row->terms);
+    while (am_nextentry(&w.solver->constraints, (am_Entry **)&ce))
+        add_table(exprs, &ce->constraint->expression.terms);
+    am_delsolver(w.solver);
+
+    known = varpool + conspool + vars.bytes + constraints.bytes + rows.bytes +
+            terms.bytes + exprs.bytes;
+    state.counters["bytes"] = (double)bytes;
+    state.counters["bytes_per_var"] = (double)bytes / w.vars.size();
+    state.counters["bytes_per_cons"] = (double)bytes / w.cons.size();
+    state.counters["varpool"] = (double)varpool;
+    state.counters["conspool"] = (double)conspool;
+    footprint_counters(state, "vars", vars);
+    footprint_counters(state, "constraints", constraints);
+    footprint_counters(state, "rows", rows);
+    footprint_counters(state, "row_terms", terms);
+    footprint_counters(state, "expressions", exprs);
+    state.counters["other"] = bytes > known ? (double)(bytes - known) : 0.0;
+}
+
+static void grid_sizes(benchmark::internal::Benchmark *b)
+{
+    b->ArgNames({ "rows", "cols" });
+    b->Args({ 8, 8 })->Args({ 12, 12 })->Args({ 16, 16 })->Args({ 24, 24 });
+}
+
+static void chain_sizes(benchmark::internal::Benchmark *b)
+{
+    b->ArgName("length")->RangeMultiplier(4)->Range(64, 4096);
+}
+
+static void tree_sizes(benchmark::internal::Benchmark *b)
+{
+    b->ArgName("depth")->DenseRange(5, 11, 2);
+}
+
+static void random_sizes(benchmark::internal::Benchmark *b)
+{
+    /* scaling at a fixed shape; see random_shapes for the other knobs */
+    b->ArgNames({ "vars", "density", "required" });
+    b->Args({ 250, 2, 50 })->Args({ 500, 2, 50 })->Args({ 1000, 2, 50 });
+    b->Args({ 2000, 2, 50 });
+}
+
+static void random_shapes(benchmark::internal::Benchmark *b)
+{
+    b->ArgNames({ "vars", "density", "required" });
+    b->Args({ 1000, 1, 50 })->Args({ 1000, 4, 50 })->Args({ 1000, 8, 50 });
+    b->Args({ 1000, 2, 10 })->Args({ 1000, 2, 90 });
+}
+
+static void flex_sizes(benchmark::internal::Benchmark *b)
+{
+    b->ArgNames({ "rows", "items" });
+    b->Args({ 10, 10 })->Args({ 20, 10 })->Args({ 20, 20 })->Args({ 40, 10 });
+}
+
+BENCHMARK_CAPTURE(BM_workload_load, grid, gen_grid)
+    ->Apply(grid_sizes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_load, chain, gen_chain)
+    ->Apply(chain_sizes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_load, tree, gen_tree)
+    ->Apply(tree_sizes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_load, random, gen_random)
+    ->Apply(random_sizes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_load, random_shape, gen_random)
+    ->Apply(random_shapes)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_load, flex, gen_flex)
+    ->Apply(flex_sizes)->Complexity()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_workload_suggest, grid, gen_grid)
+    ->Apply(grid_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_suggest, chain, gen_chain)
+    ->Apply(chain_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_suggest, tree, gen_tree)
+    ->Apply(tree_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_suggest, random, gen_random)
+    ->Apply(random_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_suggest, flex, gen_flex)
+    ->Apply(flex_sizes)->Complexity();
+
+BENCHMARK_CAPTURE(BM_workload_cycle, grid, gen_grid)
+    ->Apply(grid_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_cycle, chain, gen_chain)
+    ->Apply(chain_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_cycle, tree, gen_tree)
+    ->Apply(tree_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_cycle, random, gen_random)
+    ->Apply(random_sizes)->Complexity();
+BENCHMARK_CAPTURE(BM_workload_cycle, flex, gen_flex)
+    ->Apply(flex_sizes)->Complexity();
+
+BENCHMARK_CAPTURE(BM_workload_footprint, grid, gen_grid)
+    ->Apply(grid_sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_footprint, chain, gen_chain)
+    ->Apply(chain_sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_footprint, tree, gen_tree)
+    ->Apply(tree_sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_footprint, random, gen_random)
+    ->Apply(random_sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_workload_footprint, flex, gen_flex)
+    ->Apply(flex_sizes)->Unit(benchmark::kMillisecond);
+
 BENCHMARK_MAIN();
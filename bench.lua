@@ -0,0 +1,162 @@
+-- Runs the same workloads against the C binding (lua_amoeba.c, built as
+-- amoeba.so on package.cpath) and the pure Lua solver (amoeba.lua next to
+-- this script), reporting the time taken and what collectgarbage("count")
+-- did on the way:
+--
+--   lua bench.lua [c|lua] [build|suggest|expr|gc] [scale]
+--
+-- grown is the heap growth over the run, garbage included, and kept what
+-- is left of it after a full collection.  The C solver allocates its
+-- tableau outside the Lua heap, so its numbers only cover the userdata and
+-- the binding's tables.
+local dir = arg and arg[0] and arg[0]:match "^(.*[/\\])" or ""
+
+local impls = {}
+do
+   local path = package.searchpath("amoeba", package.cpath)
+   local open = path and package.loadlib(path, "luaopen_amoeba")
+   if open then impls[#impls+1] = { name = "c", lib = open() } end
+   local chunk = loadfile(dir .. "amoeba.lua")
+   if chunk then impls[#impls+1] = { name = "lua", lib = chunk() } end
+end
+
+local STRONG, MEDIUM, WEAK = 1000000.0, 1000.0, 1.0
+
+local function value(var)
+   -- a method on the userdata, a field on the Lua variable
+   local v = var.value
+   if type(v) == "function" then return v(var) end
+   return v
+end
+
+-- a row of n boxes with fixed gaps, preferring a width of 100 each and
+-- squeezed into a container of width 100 * n
+local function new_row(lib, n)
+   local S = lib.new()
+   local width = S:var "width"
+   local left, right = {}, {}
+   for i = 1, n do
+      left[i], right[i] = S:var("l" .. i), S:var("r" .. i)
+      S:addconstraint(right[i]:ge(left[i] + 10))
+      S:addconstraint(((right[i] - left[i]):eq(100)):strength(MEDIUM))
+      S:addconstraint((left[i]):eq(i * 110):strength(WEAK))
+      if i > 1 then
+         S:addconstraint(left[i]:ge(right[i - 1] + 10))
+      end
+   end
+   S:addconstraint(left[1]:ge(0))
+   S:addconstraint(right[n]:le(width))
+   return S, width, left, right
+end
+
+local workloads = {}
+
+workloads[#workloads+1] = { name = "build", sizes = { 25, 50, 100 },
+   run = function(lib, n)
+      local S, width, left, right = new_row(lib, n)
+      return S
+   end }
+
+workloads[#workloads+1] = { name = "suggest", sizes = { 25, 50, 100 },
+   setup = function(lib, n)
+      local S, width, left, right = new_row(lib, n)
+      S:addedit(width, STRONG)
+      return { S = S, width = width, last = right[n] }
+   end,
+   run = function(lib, n, st)
+      local sum = 0.0
+      for i = 1, 200 do
+         st.S:suggest(st.width, 50 * n + (i % 20) * 10 * n)
+         sum = sum + value(st.last)
+      end
+      assert(sum > 0.0)
+   end }
+
+-- expressions built through the operators and thrown away, never added
+workloads[#workloads+1] = { name = "expr", sizes = { 1000, 5000 },
+   setup = function(lib, n)
+      local S = lib.new()
+      return { S = S, a = S:var "a", b = S:var "b", c = S:var "c" }
+   end,
+   run = function(lib, n, st)
+      local a, b, c = st.a, st.b, st.c
+      for i = 1, n do
+         local cons = ((a + b * 2) + (c * 0.5 + i)):le(a * 3 + 10)
+      end
+   end }
+
+-- a constraint made, added and removed over and over, leaving its
+-- userdata (or table) to the collector each time
+workloads[#workloads+1] = { name = "gc", sizes = { 1000, 5000 },
+   setup = function(lib, n)
+      local S, width, left, right = new_row(lib, 10)
+      return { S = S, left = left, right = right }
+   end,
+   run = function(lib, n, st)
+      local S, left, right = st.S, st.left, st.right
+      for i = 1, n do
+         local k = i % 9 + 1
+         local cons = (left[k + 1] - right[k]):ge(i % 50)
+         S:addconstraint(cons)
+         S:delconstraint(cons)
+      end
+   end }
+
+local want, scale = {}, 1
+for _, a in ipairs(arg or {}) do
+   if tonumber(a) then scale = tonumber(a) else want[a] = true end
+end
+local function wanted(names, name)
+   for k in pairs(want) do
+      if names[k] then return want[name] end
+   end
+   return true
+end
+local impl_names, workload_names = { c = true, lua = true }, {}
+for _, w in ipairs(workloads) do workload_names[w.name] = true end
+
+-- userdata with a __gc is only freed by the cycle after the one that
+-- finalizes it
+local function fullgc()
+   collectgarbage "collect"
+   collectgarbage "collect"
+end
+
+-- run returns the solver it made, if any; solvers of the binding have to
+-- be deleted by hand
+local function measure(impl, w, n)
+   local st = w.setup and w.setup(impl.lib, n)
+   fullgc()
+   local before = collectgarbage "count"
+   local start = os.clock()
+   local S = w.run(impl.lib, n, st) or st and st.S
+   local elapsed = os.clock() - start
+   local grown = collectgarbage "count" - before
+   fullgc()
+   local kept = collectgarbage "count" - before
+   if S.delete then S:delete() end
+   return elapsed * 1e3, grown, kept
+end
+
+if #impls == 0 then
+   io.stderr:write "bench.lua: neither amoeba.so nor amoeba.lua found\n"
+   os.exit(1)
+end
+print(("%-8s %6s %-4s %10s %10s %10s %8s"):format(
+   "workload", "n", "impl", "ms", "grown KB", "kept KB", "vs c"))
+for _, w in ipairs(workloads) do
+   if wanted(workload_names, w.name) then
+      for _, size in ipairs(w.sizes) do
+         local n, base = math.floor(size * scale)
+         for _, impl in ipairs(impls) do
+            if wanted(impl_names, impl.name) then
+               local ms, grown, kept = measure(impl, w, n)
+               if impl.name == "c" then base = ms end
+               print(("%-8s %6d %-4s %10.3f %10.1f %10.1f %8s"):format(
+                  w.name, n, impl.name, ms, grown, kept,
+                  base and ("%.2fx"):format(ms / base) or "-"))
+            end
+         end
+      end
+   end
+end
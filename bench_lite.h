@@ -0,0 +1,479 @@
+/* A small stand-in for the part of Google Benchmark that bench.c uses, for
+ * machines that do not have it installed.  bench.c includes this instead
+ * of <benchmark/benchmark.h> when that header is missing or AM_BENCH_LITE
+ * is defined.
+ *
+ *   am_bench_lite [--benchmark_filter=[-]regex]
+ *                 [--benchmark_min_time=seconds]
+ *                 [--benchmark_format=console|json|csv]
+ *                 [--benchmark_out=file] [--benchmark_out_format=json|csv]
+ *
+ * Every case is run with a growing iteration count until one run takes
+ * --benchmark_min_time (0.5s by default), like Google Benchmark does.  The
+ * flags, the benchmark names and the JSON and CSV layouts follow Google
+ * Benchmark so that the same scripts read the output of either; complexity
+ * fits are not computed. */
+#ifndef AM_BENCH_LITE_H
+#define AM_BENCH_LITE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+#ifdef __GNUC__
+#define AM_BENCH_UNUSED __attribute__((unused))
+#else
+#define AM_BENCH_UNUSED
+#endif
+
+namespace benchmark {
+
+enum TimeUnit { kNanosecond, kMicrosecond, kMillisecond, kSecond };
+
+template <class T> inline void DoNotOptimize(T const &value)
+{
+#ifdef __GNUC__
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    volatile const char *p = (volatile const char *)&value;
+    (void)*p;
+#endif
+}
+
+class State {
+public:
+    struct AM_BENCH_UNUSED Value {};
+
+    struct Iterator {
+        State *state;
+        int64_t left;
+        Value operator*() const { return Value(); }
+        Iterator &operator++()
+        {
+            --left;
+            return *this;
+        }
+        bool operator!=(const Iterator &) const
+        {
+            if (left > 0 && !state->error_occurred)
+                return true;
+            state->StopTimer();
+            return false;
+        }
+    };
+
+    std::map<std::string, double> counters;
+    bool error_occurred;
+    std::string error_message;
+    double real_time, cpu_time; /* seconds spent in the timed loop */
+
+    State(const std::vector<int64_t> &args, int64_t iterations)
+        : error_occurred(false), real_time(0.0), cpu_time(0.0),
+          args_(args), iterations_(iterations), running_(false)
+    {}
+
+    Iterator begin()
+    {
+        StartTimer();
+        Iterator it = { this, iterations_ };
+        return it;
+    }
+    Iterator end()
+    {
+        Iterator it = { this, 0 };
+        return it;
+    }
+
+    int64_t range(size_t pos = 0) const { return args_.at(pos); }
+    int64_t iterations() const { return iterations_; }
+    void PauseTiming() { StopTimer(); }
+    void ResumeTiming() { StartTimer(); }
+    void SetComplexityN(int64_t) {}
+    void SkipWithError(const char *msg)
+    {
+        error_occurred = true;
+        error_message = msg;
+    }
+
+private:
+    std::vector<int64_t> args_;
+    int64_t iterations_;
+    bool running_;
+    std::chrono::steady_clock::time_point real_start_;
+    clock_t cpu_start_;
+
+    void StartTimer()
+    {
+        if (running_)
+            return;
+        running_ = true;
+        real_start_ = std::chrono::steady_clock::now();
+        cpu_start_ = clock();
+    }
+    void StopTimer()
+    {
+        std::chrono::duration<double> d;
+        if (!running_)
+            return;
+        running_ = false;
+        d = std::chrono::steady_clock::now() - real_start_;
+        real_time += d.count();
+        cpu_time += (double)(clock() - cpu_start_) / CLOCKS_PER_SEC;
+    }
+};
+
+namespace internal {
+
+class Benchmark {
+public:
+    std::string name;
+    std::function<void(State &)> fn;
+    std::vector<std::vector<int64_t> > args;
+    std::vector<std::string> arg_names;
+    TimeUnit unit;
+    int multiplier;
+
+    Benchmark(const char *n, std::function<void(State &)> f)
+        : name(n), fn(f), unit(kNanosecond), multiplier(8)
+    {}
+
+    Benchmark *Arg(int64_t x) { return Args(std::vector<int64_t>(1, x)); }
+    Benchmark *Args(const std::vector<int64_t> &x)
+    {
+        args.push_back(x);
+        return this;
+    }
+    Benchmark *ArgName(const std::string &n)
+    {
+        return ArgNames(std::vector<std::string>(1, n));
+    }
+    Benchmark *ArgNames(const std::vector<std::string> &n)
+    {
+        arg_names = n;
+        return this;
+    }
+    Benchmark *RangeMultiplier(int m)
+    {
+        multiplier = m;
+        return this;
+    }
+    Benchmark *Range(int64_t lo, int64_t hi)
+    {
+        int64_t x;
+        Arg(lo);
+        for (x = 1; x < hi; x *= multiplier)
+            if (x > lo)
+                Arg(x);
+        if (hi != lo)
+            Arg(hi);
+        return this;
+    }
+    Benchmark *DenseRange(int64_t lo, int64_t hi, int step = 1)
+    {
+        int64_t x;
+        for (x = lo; x <= hi; x += step)
+            Arg(x);
+        return this;
+    }
+    Benchmark *Apply(void (*f)(Benchmark *))
+    {
+        f(this);
+        return this;
+    }
+    Benchmark *Unit(TimeUnit u)
+    {
+        unit = u;
+        return this;
+    }
+    Benchmark *Complexity() { return this; }
+};
+
+struct Result {
+    std::string name;
+    int64_t iterations;
+    double real_time, cpu_time; /* per iteration, in unit */
+    const char *unit;
+    std::map<std::string, double> counters;
+    bool error_occurred;
+    std::string error_message;
+};
+
+inline std::vector<Benchmark *> &Registry()
+{
+    static std::vector<Benchmark *> benchmarks;
+    return benchmarks;
+}
+
+inline Benchmark *Register(const char *name, std::function<void(State &)> f)
+{
+    Registry().push_back(new Benchmark(name, f));
+    return Registry().back();
+}
+
+inline std::string RunName(const Benchmark *b, const std::vector<int64_t> &a)
+{
+    std::string name = b->name;
+    size_t i;
+    for (i = 0; i < a.size(); ++i) {
+        name += "/";
+        if (i < b->arg_names.size() && !b->arg_names[i].empty())
+            name += b->arg_names[i] + ":";
+        name += std::to_string((long long)a[i]);
+    }
+    return name;
+}
+
+inline Result Run(const Benchmark *b, const std::vector<int64_t> &a,
+                  double min_time)
+{
+    static const char *units[] = { "ns", "us", "ms", "s" };
+    static const double scales[] = { 1e9, 1e6, 1e3, 1.0 };
+    Result r;
+    int64_t n = 1;
+    for (;;) {
+        State state(a, n);
+        double grow;
+        b->fn(state);
+        if (state.error_occurred || state.real_time >= min_time ||
+            n >= 1000000000) {
+            r.name = RunName(b, a);
+            r.iterations = n;
+            r.real_time = state.real_time * scales[b->unit] / (double)n;
+            r.cpu_time = state.cpu_time * scales[b->unit] / (double)n;
+            r.unit = units[b->unit];
+            r.counters = state.counters;
+            r.error_occurred = state.error_occurred;
+            r.error_message = state.error_message;
+            return r;
+        }
+        grow = state.real_time > 0.0 ? min_time * 1.4 / state.real_time
+                                     : 10.0;
+        grow = grow > 10.0 ? 10.0 : grow < 1.1 ? 1.1 : grow;
+        n = (int64_t)((double)n * grow) + 1;
+    }
+}
+
+inline std::string Escape(const std::string &s)
+{
+    std::string out;
+    size_t i;
+    for (i = 0; i < s.size(); ++i) {
+        if (s[i] == '"' || s[i] == '\\')
+            out += '\\';
+        out += s[i];
+    }
+    return out;
+}
+
+inline void ReportConsoleHeader(FILE *fp)
+{
+    fprintf(fp, "%-48s %15s %15s %12s\n", "Benchmark", "Time", "CPU",
+            "Iterations");
+}
+
+inline int Digits(double t)
+{
+    return t < 10.0 ? 3 : t < 100.0 ? 2 : t < 1000.0 ? 1 : 0;
+}
+
+inline void ReportConsoleRow(FILE *fp, const Result &r)
+{
+    std::map<std::string, double>::const_iterator c;
+    if (r.error_occurred) {
+        fprintf(fp, "%-48s ERROR OCCURRED: '%s'\n", r.name.c_str(),
+                r.error_message.c_str());
+        return;
+    }
+    fprintf(fp, "%-48s %12.*f %-2s %12.*f %-2s %12lld", r.name.c_str(),
+            Digits(r.real_time), r.real_time, r.unit, Digits(r.cpu_time),
+            r.cpu_time, r.unit, (long long)r.iterations);
+    for (c = r.counters.begin(); c != r.counters.end(); ++c)
+        fprintf(fp, " %s=%g", c->first.c_str(), c->second);
+    fprintf(fp, "\n");
+}
+
+inline void ReportJSON(FILE *fp, const char *executable,
+                       const std::vector<Result> &results)
+{
+    char date[64];
+    time_t now = time(NULL);
+    size_t i;
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    fprintf(fp, "{\n  \"context\": {\n    \"date\": \"%s\",\n", date);
+    fprintf(fp, "    \"executable\": \"%s\",\n",
+            Escape(executable).c_str());
+    fprintf(fp, "    \"library_build_type\": \"bench_lite\"\n  },\n");
+    fprintf(fp, "  \"benchmarks\": [");
+    for (i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        std::map<std::string, double>::const_iterator c;
+        fprintf(fp, "%s\n    {\n", i ? "," : "");
+        fprintf(fp, "      \"name\": \"%s\",\n", Escape(r.name).c_str());
+        fprintf(fp, "      \"run_name\": \"%s\",\n", Escape(r.name).c_str());
+        fprintf(fp, "      \"run_type\": \"iteration\",\n");
+        if (r.error_occurred) {
+            fprintf(fp, "      \"error_occurred\": true,\n");
+            fprintf(fp, "      \"error_message\": \"%s\"\n    }",
+                    Escape(r.error_message).c_str());
+            continue;
+        }
+        fprintf(fp, "      \"iterations\": %lld,\n", (long long)r.iterations);
+        fprintf(fp, "      \"real_time\": %.10g,\n", r.real_time);
+        fprintf(fp, "      \"cpu_time\": %.10g,\n", r.cpu_time);
+        fprintf(fp, "      \"time_unit\": \"%s\"", r.unit);
+        for (c = r.counters.begin(); c != r.counters.end(); ++c)
+            fprintf(fp, ",\n      \"%s\": %.10g", Escape(c->first).c_str(),
+                    c->second);
+        fprintf(fp, "\n    }");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+inline void ReportCSV(FILE *fp, const std::vector<Result> &results)
+{
+    std::vector<std::string> names;
+    size_t i, j;
+    for (i = 0; i < results.size(); ++i) {
+        std::map<std::string, double>::const_iterator c;
+        for (c = results[i].counters.begin(); c != results[i].counters.end();
+             ++c) {
+            for (j = 0; j < names.size() && names[j] != c->first; ++j)
+                ;
+            if (j == names.size())
+                names.push_back(c->first);
+        }
+    }
+    fprintf(fp, "name,iterations,real_time,cpu_time,time_unit,"
+                "error_occurred,error_message");
+    for (j = 0; j < names.size(); ++j)
+        fprintf(fp, ",\"%s\"", names[j].c_str());
+    fprintf(fp, "\n");
+    for (i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        fprintf(fp, "\"%s\",", r.name.c_str());
+        if (r.error_occurred) {
+            fprintf(fp, ",,,,true,\"%s\"", r.error_message.c_str());
+        } else {
+            fprintf(fp, "%lld,%.10g,%.10g,%s,,", (long long)r.iterations,
+                    r.real_time, r.cpu_time, r.unit);
+        }
+        for (j = 0; j < names.size(); ++j) {
+            std::map<std::string, double>::const_iterator c =
+                r.counters.find(names[j]);
+            fprintf(fp, ",");
+            if (c != r.counters.end())
+                fprintf(fp, "%.10g", c->second);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+inline void Report(FILE *fp, const std::string &format, const char *exe,
+                   const std::vector<Result> &results)
+{
+    size_t i;
+    if (format == "json")
+        ReportJSON(fp, exe, results);
+    else if (format == "csv")
+        ReportCSV(fp, results);
+    else {
+        ReportConsoleHeader(fp);
+        for (i = 0; i < results.size(); ++i)
+            ReportConsoleRow(fp, results[i]);
+    }
+}
+
+inline bool Flag(const char *arg, const char *name, std::string *value)
+{
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=')
+        return false;
+    *value = arg + len + 1;
+    return true;
+}
+
+inline int RunMain(int argc, char **argv)
+{
+    std::string filter = ".", min_time = "0.5", format = "console";
+    std::string out, out_format = "json", value;
+    std::vector<Result> results;
+    size_t i, j;
+    int k;
+    for (k = 1; k < argc; ++k) {
+        if (Flag(argv[k], "--benchmark_filter", &filter) ||
+            Flag(argv[k], "--benchmark_min_time", &min_time) ||
+            Flag(argv[k], "--benchmark_format", &format) ||
+            Flag(argv[k], "--benchmark_out", &out) ||
+            Flag(argv[k], "--benchmark_out_format", &out_format))
+            continue;
+        fprintf(stderr, "%s: unknown argument '%s'\n", argv[0], argv[k]);
+        return 1;
+    }
+    bool negative = !filter.empty() && filter[0] == '-';
+    std::regex re(negative ? filter.substr(1) : filter);
+    if (format == "console")
+        ReportConsoleHeader(stdout);
+    for (i = 0; i < Registry().size(); ++i) {
+        Benchmark *b = Registry()[i];
+        std::vector<std::vector<int64_t> > args = b->args;
+        if (args.empty())
+            args.push_back(std::vector<int64_t>());
+        for (j = 0; j < args.size(); ++j) {
+            if (std::regex_search(RunName(b, args[j]), re) == negative)
+                continue;
+            results.push_back(Run(b, args[j], atof(min_time.c_str())));
+            if (format == "console") {
+                ReportConsoleRow(stdout, results.back());
+                fflush(stdout);
+            }
+        }
+    }
+    if (format != "console")
+        Report(stdout, format, argv[0], results);
+    if (!out.empty()) {
+        FILE *fp = fopen(out.c_str(), "w");
+        if (fp == NULL) {
+            fprintf(stderr, "%s: cannot open %s\n", argv[0], out.c_str());
+            return 1;
+        }
+        Report(fp, out_format, argv[0], results);
+        fclose(fp);
+    }
+    return 0;
+}
+
+} /* namespace internal */
+
+} /* namespace benchmark */
+
+#define AM_BENCH_CAT2(a, b) a##b
+#define AM_BENCH_CAT(a, b) AM_BENCH_CAT2(a, b)
+
+#define BENCHMARK(f)                                                   \
+    static ::benchmark::internal::Benchmark *AM_BENCH_UNUSED           \
+        AM_BENCH_CAT(am_bench_, __LINE__) =                            \
+            ::benchmark::internal::Register(#f, f)
+
+#define BENCHMARK_CAPTURE(f, name, ...)                                \
+    static ::benchmark::internal::Benchmark *AM_BENCH_UNUSED           \
+        AM_BENCH_CAT(am_bench_, __LINE__) =                            \
+            ::benchmark::internal::Register(                           \
+                #f "/" #name,                                          \
+                [](::benchmark::State &st) { f(st, __VA_ARGS__); })
+
+#define BENCHMARK_MAIN()                                               \
+    int main(int argc, char **argv)                                    \
+    {                                                                  \
+        return ::benchmark::internal::RunMain(argc, argv);             \
+    }
+
+#endif /* AM_BENCH_LITE_H */
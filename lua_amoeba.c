@@ -4,7 +4,7 @@
 #include <string.h>
 
 #define AM_STATIC_API
-#include "amoeba.h"
+#include "amoeba.c"
 
 #define AML_SOLVER_TYPE "amoeba.Solver"
 #define AML_VAR_TYPE "amoeba.Variable"
@@ -247,14 +247,14 @@ static void aml_dumpkey(luaL_Buffer *B, int idx, am_Symbol sym)
 {
     lua_State *L = B->L;
     aml_Var *lvar;
-    lua_rawgeti(L, idx, sym.id);
+    lua_rawgeti(L, idx, am_Symbol_id(sym));
     lvar = (aml_Var *)luaL_testudata(L, -1, AML_VAR_TYPE);
     lua_pop(L, 1);
     if (lvar)
         luaL_addstring(B, lvar->name);
     else {
         int ch = 'v';
-        switch (sym.type) {
+        switch (am_Symbol_type(sym)) {
         case AM_EXTERNAL:
             ch = 'v';
             break;
@@ -268,7 +268,7 @@ static void aml_dumpkey(luaL_Buffer *B, int idx, am_Symbol sym)
             ch = 'd';
             break;
         }
-        lua_pushfstring(L, "%c%d", ch, sym.id);
+        lua_pushfstring(L, "%c%d", ch, (int)am_Symbol_id(sym));
         luaL_addvalue(B);
     }
 }
@@ -577,7 +577,7 @@ static int Lcons_tostring(lua_State *L)
         luaL_addstring(&B, " == 0.0]");
     else
         luaL_addstring(&B, " >= 0.0]");
-    if (lcons->cons->marker.id != 0) {
+    if (am_Symbol_id(lcons->cons->marker) != 0) {
         luaL_addstring(&B, "(added:");
         aml_dumpkey(&B, 2, lcons->cons->marker);
         luaL_addchar(&B, '-');
@@ -625,6 +625,7 @@ static int Lnew(lua_State *L)
     aml_Solver *S = lua_newuserdata(L, sizeof(aml_Solver));
     if ((S->solver = am_newsolver(NULL, NULL)) == NULL)
         return 0;
+    am_autoupdate(S->solver, 1); /* values follow, as in amoeba.lua */
     lua_createtable(L, 0, 4);
     aml_setweak(L, "v");
     S->ref_vars = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -668,7 +669,7 @@ static int Ldelete(lua_State *L)
     return 0;
 }
 
-static int Ltostring(lua_State *L)
+static int Ldump(lua_State *L)
 {
     aml_Solver *S = (aml_Solver *)luaL_checkudata(L, 1, AML_SOLVER_TYPE);
     luaL_Buffer B;
@@ -692,7 +693,7 @@ static int Ltostring(lua_State *L)
             aml_dumprow(&B, 2, row);
         }
     }
-    if (S->solver->infeasible_rows.id != 0) {
+    if (am_Symbol_id(S->solver->infeasible_rows) != 0) {
         am_Row *row =
             (am_Row *)am_gettable(&S->solver->rows, S->solver->infeasible_rows);
         luaL_addstring(&B, "\n  infeasible rows: ");
@@ -703,6 +704,72 @@ static int Ltostring(lua_State *L)
             row = (am_Row *)am_gettable(&S->solver->rows, row->infeasible_next);
         }
     }
+    if (S->solver->infeasible_count != 0) {
+        size_t i;
+        luaL_addstring(&B, "\n  infeasible heap: ");
+        for (i = 0; i < S->solver->infeasible_count; ++i) {
+            if (i != 0)
+                luaL_addstring(&B, ", ");
+            aml_dumpkey(&B, 2, S->solver->infeasible_heap[i].row);
+        }
+    }
+    luaL_addstring(&B, "\n}");
+    luaL_pushresult(&B);
+    return 1;
+}
+
+static void aml_addbuckets(luaL_Buffer *B, const char *name, size_t max,
+                           const size_t *buckets)
+{
+    lua_State *L = B->L;
+    int i;
+    lua_pushfstring(L, "\n  %s = { max = %d", name, (int)max);
+    luaL_addvalue(B);
+    for (i = 0; i < AM_HEALTH_BUCKETS; ++i) {
+        if (buckets[i] == 0)
+            continue;
+        if (i < 2)
+            lua_pushfstring(L, ", %d = %d", i, (int)buckets[i]);
+        else if (i == AM_HEALTH_BUCKETS - 1)
+            lua_pushfstring(L, ", %d+ = %d", 1 << (i - 1), (int)buckets[i]);
+        else
+            lua_pushfstring(L, ", %d-%d = %d", 1 << (i - 1), (1 << i) - 1,
+                            (int)buckets[i]);
+        luaL_addvalue(B);
+    }
+    luaL_addstring(B, " }");
+}
+
+/* a summary of the tableau, S:dump() has all of the rows */
+static int Ltostring(lua_State *L)
+{
+    aml_Solver *S = (aml_Solver *)luaL_checkudata(L, 1, AML_SOLVER_TYPE);
+    am_Health h;
+    luaL_Buffer B;
+    if (S->solver == NULL) {
+        lua_pushstring(L, AML_SOLVER_TYPE ": deleted");
+        return 1;
+    }
+    am_gethealth(S->solver, &h);
+    luaL_buffinit(L, &B);
+    lua_pushfstring(L,
+                    AML_SOLVER_TYPE "(%p): {"
+                    "\n  rows = %d, nonzeros = %d, objective terms = %d",
+                    S->solver, (int)h.rows, (int)h.nonzeros,
+                    (int)h.objective_terms);
+    luaL_addvalue(&B);
+    lua_pushfstring(L,
+                    "\n  basic = { external = %d, slack = %d, error = %d,"
+                    " dummy = %d }",
+                    (int)h.basic[0], (int)h.basic[1], (int)h.basic[2],
+                    (int)h.basic[3]);
+    luaL_addvalue(&B);
+    aml_addbuckets(&B, "row lengths", h.max_row_length, h.row_lengths);
+    aml_addbuckets(&B, "column counts", h.max_column_count, h.column_counts);
+    lua_pushfstring(L, "\n  coefficients = [%f, %f], near epsilon = %d",
+                    (lua_Number)h.min_coefficient,
+                    (lua_Number)h.max_coefficient, (int)h.near_epsilon);
+    luaL_addvalue(&B);
     luaL_addstring(&B, "\n}");
     luaL_pushresult(&B);
     return 1;
@@ -783,6 +850,7 @@ LUALIB_API int luaopen_amoeba(lua_State *L)
 #define ENTRY(name) {#name, L##name}
                        ENTRY(new),
                        ENTRY(delete),
+                       ENTRY(dump),
                        ENTRY(reset),
                        ENTRY(addconstraint),
                        ENTRY(delconstraint),
@@ -0,0 +1,118 @@
+/* Replays a recording made with am_record and reports the time spent in
+ * each kind of call, so that a call stream taken from a real program can
+ * be kept around as a performance regression:
+ *
+ *   am_replay solver.amrc [repeat]
+ */
+#define _POSIX_C_SOURCE 199309L
+#include "amoeba.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_CALLS 64
+
+typedef struct CallStats {
+    const char *name;
+    size_t count;
+    double total; /* seconds */
+    double max;
+} CallStats;
+
+typedef struct Replay {
+    CallStats calls[MAX_CALLS];
+    size_t ncalls;
+    double start;
+} Replay;
+
+static double now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static CallStats *find_call(Replay *r, const char *name)
+{
+    size_t i;
+    for (i = 0; i < r->ncalls; ++i)
+        if (strcmp(r->calls[i].name, name) == 0)
+            return &r->calls[i];
+    if (r->ncalls == MAX_CALLS)
+        return NULL;
+    memset(&r->calls[r->ncalls], 0, sizeof(CallStats));
+    r->calls[r->ncalls].name = name;
+    return &r->calls[r->ncalls++];
+}
+
+static void add_time(Replay *r, const char *name, double elapsed)
+{
+    CallStats *cs = find_call(r, name);
+    if (cs == NULL)
+        return;
+    ++cs->count;
+    cs->total += elapsed;
+    if (elapsed > cs->max)
+        cs->max = elapsed;
+}
+
+static void on_call(void *ud, const char *call, int done)
+{
+    Replay *r = (Replay *)ud;
+    double t = now();
+    if (!done)
+        r->start = t;
+    else
+        add_time(r, call, t - r->start);
+}
+
+static int by_total(const void *lhs, const void *rhs)
+{
+    double a = ((const CallStats *)lhs)->total;
+    double b = ((const CallStats *)rhs)->total;
+    return a < b ? 1 : a > b ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    Replay r;
+    double start, total;
+    size_t i;
+    int run, repeat = argc > 2 ? atoi(argv[2]) : 1;
+    if (argc < 2 || repeat < 1) {
+        fprintf(stderr, "usage: %s recording [repeat]\n", argv[0]);
+        return 2;
+    }
+    memset(&r, 0, sizeof(r));
+    start = now();
+    for (run = 0; run < repeat; ++run) {
+        am_Solver *solver = am_newsolver(NULL, NULL);
+        if (am_replay(solver, argv[1], on_call, &r) != AM_OK) {
+            fprintf(stderr, "%s: cannot replay %s\n", argv[0], argv[1]);
+            am_delsolver(solver);
+            return 1;
+        }
+        r.start = now();
+        am_delsolver(solver);
+        add_time(&r, "am_delsolver", now() - r.start);
+    }
+    total = now() - start;
+
+    qsort(r.calls, r.ncalls, sizeof(CallStats), by_total);
+    printf("%-20s %10s %12s %10s %10s\n", "call", "count", "total ms",
+           "mean us", "max us");
+    for (i = 0; i < r.ncalls; ++i) {
+        CallStats *cs = &r.calls[i];
+        printf("%-20s %10lu %12.3f %10.3f %10.3f\n", cs->name,
+               (unsigned long)cs->count, cs->total * 1e3,
+               cs->total * 1e6 / (double)cs->count, cs->max * 1e6);
+    }
+    printf("%d run(s) in %.3f ms\n", repeat, total * 1e3);
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "amoeba_p.h"
 
 #include <assert.h>
+#include <math.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -103,12 +104,12 @@ static void am_dumpsolver(am_Solver *solver)
     printf("-------------------------------\n");
 }
 
-static am_Constraint *new_constraint(am_Solver *in_solver, double in_strength,
-                                     am_Variable *in_term1, double in_factor1,
-                                     int in_relation, double in_constant, ...)
+static am_Constraint *build_constraint(am_Solver *in_solver,
+                                       double in_strength,
+                                       am_Variable *in_term1, double in_factor1,
+                                       int in_relation, double in_constant,
+                                       va_list argp)
 {
-    int result;
-    va_list argp;
     am_Constraint *c;
     assert(in_solver && in_term1);
     c = am_newconstraint(in_solver, (am_Float)in_strength);
@@ -118,7 +119,6 @@ static am_Constraint *new_constraint(am_Solver *in_solver, double in_strength,
     am_setrelation(c, in_relation);
     if (in_constant)
         am_addconstant(c, (am_Float)in_constant);
-    va_start(argp, in_constant);
     while (1) {
         am_Variable *va_term = va_arg(argp, am_Variable *);
         double va_factor = va_arg(argp, double);
@@ -126,12 +126,43 @@ static am_Constraint *new_constraint(am_Solver *in_solver, double in_strength,
             break;
         am_addterm(c, va_term, (am_Float)va_factor);
     }
+    return c;
+}
+
+static am_Constraint *new_constraint(am_Solver *in_solver, double in_strength,
+                                     am_Variable *in_term1, double in_factor1,
+                                     int in_relation, double in_constant, ...)
+{
+    int result;
+    va_list argp;
+    am_Constraint *c;
+    va_start(argp, in_constant);
+    c = build_constraint(in_solver, in_strength, in_term1, in_factor1,
+                         in_relation, in_constant, argp);
     va_end(argp);
+    if (!c)
+        return 0;
     result = am_add(c);
     assert(result == AM_OK);
     return c;
 }
 
+static am_Constraint *unadded_constraint(am_Solver *in_solver,
+                                         double in_strength,
+                                         am_Variable *in_term1,
+                                         double in_factor1, int in_relation,
+                                         double in_constant, ...)
+{
+    /* new_constraint without the am_add, for groups */
+    va_list argp;
+    am_Constraint *c;
+    va_start(argp, in_constant);
+    c = build_constraint(in_solver, in_strength, in_term1, in_factor1,
+                         in_relation, in_constant, argp);
+    va_end(argp);
+    return c;
+}
+
 static void test_all()
 {
     printf("test_all...\n");
@@ -927,6 +958,1941 @@ void test_null()
     printf("test_null passed\n");
 }
 
+static void test_disable()
+{
+    printf("test_disable...\n");
+    am_Solver *solver;
+    am_Variable *x;
+    am_Constraint *c1, *c2, *c3, *c4;
+    am_Constraint *group[2];
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = am_newsolver(debug_allocf, NULL);
+    am_autoupdate(solver, 1);
+    x = am_newvariable(solver);
+
+    assert(am_disable(NULL) == AM_FAILED);
+    assert(am_enable(NULL) == AM_FAILED);
+    assert(!am_isdisabled(NULL));
+
+    c1 = new_constraint(solver, AM_REQUIRED, x, 1.0, AM_GREATEQUAL, 0.0, END);
+    c2 = new_constraint(solver, AM_WEAK, x, 1.0, AM_EQUAL, 100.0, END);
+    c3 = new_constraint(solver, AM_STRONG, x, 1.0, AM_EQUAL, 50.0, END);
+    c4 = new_constraint(solver, AM_REQUIRED, x, 1.0, AM_LESSEQUAL, 80.0, END);
+    assert(solver->rows.count == 4);
+    assert(am_value(x) == 50.0);
+
+    /* non-required: rows stay, only the objective changes */
+    ret = am_disable(c3);
+    assert(ret == AM_OK);
+    assert(am_isdisabled(c3));
+    assert(am_hasconstraint(c3));
+    assert(solver->rows.count == 4);
+    assert(am_value(x) == 80.0);
+    assert(am_disable(c3) == AM_OK);
+    assert(am_add(c3) == AM_FAILED);
+
+    /* required: taken out of the tableau until enabled again */
+    ret = am_disable(c4);
+    assert(ret == AM_OK);
+    assert(am_isdisabled(c4));
+    assert(am_hasconstraint(c4));
+    assert(solver->rows.count == 3);
+    assert(am_value(x) == 100.0);
+
+    ret = am_enable(c4);
+    assert(ret == AM_OK);
+    assert(!am_isdisabled(c4));
+    assert(am_value(x) == 80.0);
+    ret = am_enable(c3);
+    assert(ret == AM_OK);
+    assert(!am_isdisabled(c3));
+    assert(am_value(x) == 50.0);
+    assert(am_enable(c3) == AM_OK);
+
+    group[0] = c3, group[1] = c4;
+    ret = am_disablegroup(group, 2);
+    assert(ret == AM_OK);
+    assert(am_value(x) == 100.0);
+    ret = am_enablegroup(group, 2);
+    assert(ret == AM_OK);
+    assert(am_value(x) == 50.0);
+
+    /* strength changes are remembered while disabled */
+    am_disable(c3);
+    assert(am_setstrength(c3, AM_WEAK) == AM_OK);
+    assert(am_isdisabled(c3));
+    assert(am_value(x) == 80.0);
+    am_enable(c3);
+    assert(am_value(x) == 80.0);
+    assert(am_setstrength(c3, AM_STRONG) == AM_OK);
+    assert(am_value(x) == 50.0);
+
+    /* a disabled constraint that can't be satisfied stays disabled */
+    am_disable(c2);
+    assert(am_setstrength(c2, AM_REQUIRED) == AM_OK);
+    assert(am_isdisabled(c2));
+    ret = am_enable(c2);
+    assert(ret != AM_OK);
+    assert(am_isdisabled(c2));
+    assert(am_value(x) == 50.0);
+
+    am_remove(c2);
+    assert(!am_isdisabled(c2));
+    assert(!am_hasconstraint(c2));
+    am_disable(c3);
+    am_remove(c3);
+    assert(!am_hasconstraint(c3));
+    assert(am_value(x) >= 0.0 && am_value(x) <= 80.0);
+    assert(am_disable(c3) == AM_FAILED);
+    am_delconstraint(c1);
+
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_disable passed\n");
+}
+
+static void test_suspendedit()
+{
+    printf("test_suspendedit...\n");
+    am_Solver *solver;
+    am_Variable *x, *y;
+    size_t rows;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = am_newsolver(debug_allocf, NULL);
+    am_autoupdate(solver, 1);
+    x = am_newvariable(solver);
+    y = am_newvariable(solver);
+
+    assert(am_suspendedit(NULL) == AM_FAILED);
+    assert(am_resumeedit(NULL) == AM_FAILED);
+    assert(am_suspendedit(x) == AM_FAILED);
+
+    /* y == x + 10, x prefers 10 */
+    new_constraint(solver, AM_REQUIRED, y, 1.0, AM_EQUAL, 10.0, x, 1.0, END);
+    new_constraint(solver, AM_WEAK, x, 1.0, AM_EQUAL, 10.0, END);
+
+    am_addedit(x, AM_STRONG);
+    am_suggest(x, 50.0);
+    assert(am_value(x) == 50.0);
+    assert(am_value(y) == 60.0);
+    rows = solver->rows.count;
+
+    /* suspended: the edit stays resident but no longer pulls */
+    ret = am_suspendedit(x);
+    assert(ret == AM_OK);
+    assert(am_hasedit(x));
+    assert(solver->rows.count == rows);
+    assert(am_value(x) == 10.0);
+    assert(am_value(y) == 20.0);
+
+    /* resuming starts from the current value */
+    ret = am_resumeedit(x);
+    assert(ret == AM_OK);
+    assert(solver->rows.count == rows);
+    assert(am_value(x) == 10.0);
+    am_suggest(x, 70.0);
+    assert(am_value(x) == 70.0);
+    assert(am_value(y) == 80.0);
+    assert(am_resumeedit(x) == AM_OK);
+
+    /* suggesting resumes a suspended edit */
+    am_suspendedit(x);
+    assert(am_value(x) == 10.0);
+    am_suggest(x, 30.0);
+    assert(am_value(x) == 30.0);
+    assert(am_value(y) == 40.0);
+
+    /* adding an edit resumes it as well */
+    am_suspendedit(x);
+    assert(am_addedit(x, AM_STRONG) == AM_OK);
+    assert(am_addedit(x, AM_STRONG) == AM_FAILED);
+    assert(am_value(x) == 10.0);
+    am_suggest(x, 0.0);
+    assert(am_value(y) == 10.0);
+
+    am_suspendedit(x);
+    am_deledit(x);
+    assert(!am_hasedit(x));
+    assert(am_value(x) == 10.0);
+
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_suspendedit passed\n");
+}
+
+static am_Solver *new_chain(am_Variable **vars, int count)
+{
+    am_Solver *solver = am_newsolver(debug_allocf, NULL);
+    int i;
+    am_autoupdate(solver, 1);
+    for (i = 0; i < count; ++i) {
+        vars[i] = am_newvariable(solver);
+        new_constraint(solver, AM_WEAK, vars[i], 1.0, AM_EQUAL, 20.0 * i, END);
+        if (i > 0)
+            new_constraint(solver, AM_REQUIRED, vars[i], 1.0, AM_GREATEQUAL,
+                           5.0, vars[i - 1], 1.0, END);
+    }
+    return solver;
+}
+
+static void test_budget()
+{
+    printf("test_budget...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[10], *rx[10];
+    am_Constraint *c, *rc;
+    int i, calls;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = new_chain(x, 10);
+    ref = new_chain(rx, 10);
+    am_setbudget(solver, 2);
+    assert(am_resume(NULL) == AM_FAILED);
+    assert(am_resume(solver) == AM_OK);
+    assert(!am_incomplete(NULL) && !am_incomplete(solver));
+
+    /* pushing the first box moves the whole chain, one pivot per box */
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(rx[0], AM_STRONG);
+    am_suggest(x[0], 500.0);
+    assert(am_incomplete(solver));
+    am_suggest(rx[0], 500.0);
+    assert(!am_incomplete(ref));
+    for (i = 0; i < 10; ++i)
+        assert(am_value(x[i]) == 20.0 * i); /* last feasible solution */
+    for (calls = 1, ret = AM_INCOMPLETE; ret == AM_INCOMPLETE; ++calls)
+        ret = am_resume(solver);
+    assert(ret == AM_OK);
+    assert(calls > 2);
+    for (i = 0; i < 10; ++i)
+        assert(am_value(x[i]) == am_value(rx[i]));
+
+    /* a new suggest continues from an unfinished one */
+    am_suggest(x[0], 0.0);
+    assert(am_incomplete(solver));
+    am_suggest(x[0], 100.0);
+    ret = am_incomplete(solver) ? AM_INCOMPLETE : AM_OK;
+    am_suggest(rx[0], 100.0);
+    while (ret == AM_INCOMPLETE)
+        ret = am_resume(solver);
+    for (i = 0; i < 10; ++i)
+        assert(am_value(x[i]) == am_value(rx[i]));
+
+    /* structural changes finish pending work first */
+    am_suggest(x[0], 500.0);
+    assert(am_incomplete(solver));
+    am_suggest(rx[0], 500.0);
+    c = am_newconstraint(solver, AM_WEAK);
+    am_addterm(c, x[9], 1.0);
+    am_setrelation(c, AM_EQUAL);
+    ret = am_add(c);
+    assert(ret == AM_OK || ret == AM_INCOMPLETE);
+    rc = new_constraint(ref, AM_WEAK, rx[9], 1.0, AM_EQUAL, 0.0, END);
+    while (ret == AM_INCOMPLETE)
+        ret = am_resume(solver);
+    for (i = 0; i < 10; ++i)
+        assert(am_value(x[i]) == am_value(rx[i]));
+
+    /* an unfinished primal phase is feasible but not optimal yet */
+    am_setbudget(solver, 1);
+    am_setstrength(rc, AM_STRONG);
+    ret = am_setstrength(c, AM_STRONG);
+    assert(ret == AM_INCOMPLETE);
+    for (i = 1; i < 10; ++i)
+        assert(am_value(x[i]) >= am_value(x[i - 1]) + 5.0);
+    while (ret == AM_INCOMPLETE)
+        ret = am_resume(solver);
+    for (i = 0; i < 10; ++i)
+        assert(am_value(x[i]) == am_value(rx[i]));
+
+    am_remove(c);
+    am_remove(rc);
+    am_setbudget(solver, 0);
+    assert(am_resume(solver) == AM_OK);
+    for (i = 0; i < 10; ++i)
+        assert(am_value(x[i]) == am_value(rx[i]));
+
+    am_delsolver(ref);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_budget passed\n");
+}
+
+static am_Solver *new_tree(am_Variable **x, am_Variable **y,
+                           am_Constraint **links, int count, int presolve)
+{
+    am_Solver *solver = am_newsolver(debug_allocf, NULL);
+    int i;
+    am_autoupdate(solver, 1);
+    am_presolve(solver, presolve);
+    for (i = 0; i < count; ++i) {
+        x[i] = am_newvariable(solver);
+        y[i] = am_newvariable(solver);
+        new_constraint(solver, AM_WEAK, x[i], 1.0, AM_EQUAL, 0.0, END);
+        if (i == 0) {
+            new_constraint(solver, AM_REQUIRED, x[i], 1.0, AM_GREATEQUAL, 0.0,
+                           END);
+            continue;
+        }
+        /* y_child = y_parent + 15 */
+        links[i] = new_constraint(solver, AM_REQUIRED, y[i], 1.0, AM_EQUAL,
+                                  15.0, y[(i - 1) / 2], 1.0, END);
+        new_constraint(solver, AM_REQUIRED, x[i], 1.0, AM_GREATEQUAL, 5.0,
+                       x[i - 1], 1.0, END);
+    }
+    return solver;
+}
+
+static void test_presolve()
+{
+    printf("test_presolve...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[63], *y[63], *rx[63], *ry[63], *z;
+    am_Constraint *links[63], *rlinks[63], *c;
+    int i;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = new_tree(x, y, links, 63, 1);
+    ref = new_tree(rx, ry, rlinks, 63, 0);
+    assert(solver->rows.count + 62 == ref->rows.count);
+    for (i = 0; i < 63; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    /* edits on aliased variables move the whole component */
+    am_addedit(y[0], AM_STRONG);
+    am_addedit(ry[0], AM_STRONG);
+    am_suggest(y[0], 100.0);
+    am_suggest(ry[0], 100.0);
+    am_addedit(y[62], AM_MEDIUM);
+    am_addedit(ry[62], AM_MEDIUM);
+    am_suggest(y[62], 50.0);
+    am_suggest(ry[62], 50.0);
+    assert(am_approx(am_value(y[62]), 175.0));
+    for (i = 0; i < 63; ++i)
+        assert(am_approx(am_value(y[i]), am_value(ry[i])));
+    am_suspendedit(y[62]);
+    am_suspendedit(ry[62]);
+    am_deledit(y[0]);
+    am_deledit(ry[0]);
+    am_addedit(y[30], AM_STRONG);
+    am_addedit(ry[30], AM_STRONG);
+    am_suggest(y[30], -20.0);
+    am_suggest(ry[30], -20.0);
+    assert(am_approx(am_value(y[0]), -80.0));
+    for (i = 0; i < 63; ++i)
+        assert(am_approx(am_value(y[i]), am_value(ry[i])));
+
+    /* fixed variables, redundant and contradicting equalities */
+    z = am_newvariable(solver);
+    new_constraint(solver, AM_REQUIRED, z, 2.0, AM_EQUAL, 84.0, END);
+    assert(am_approx(am_value(z), 42.0));
+    c = am_newconstraint(solver, AM_REQUIRED);
+    am_addterm(c, z, 1.0);
+    am_setrelation(c, AM_EQUAL);
+    am_addconstant(c, 43.0);
+    assert(am_add(c) == AM_UNSATISFIED);
+    assert(!am_hasconstraint(c));
+    am_resetconstraint(c);
+    am_addterm(c, y[7], 1.0);
+    am_setrelation(c, AM_EQUAL);
+    am_addterm(c, y[3], 1.0);
+    am_addconstant(c, 15.0);
+    assert(am_add(c) == AM_OK);
+    am_remove(c);
+    am_addconstant(c, 1.0);
+    assert(am_add(c) == AM_UNSATISFIED);
+    am_delconstraint(c);
+
+    /* removing a presolved link turns the links back into rows */
+    am_remove(links[5]);
+    am_remove(rlinks[5]);
+    assert(!am_hasconstraint(links[5]));
+    assert(am_hasconstraint(links[6]));
+    am_add(links[5]);
+    am_add(rlinks[5]);
+    for (i = 0; i < 63; ++i) {
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+        assert(am_approx(am_value(y[i]), am_value(ry[i])));
+    }
+    assert(am_approx(am_value(z), 42.0));
+    am_disable(links[9]);
+    am_setstrength(links[10], AM_STRONG);
+    am_setstrength(rlinks[10], AM_STRONG);
+    am_presolve(solver, 0);
+    am_enable(links[9]);
+    for (i = 0; i < 63; ++i)
+        assert(am_approx(am_value(y[i]), am_value(ry[i])));
+    am_delsolver(ref);
+    am_delsolver(solver);
+
+    /* reset keeps the resolved values */
+    solver = am_newsolver(debug_allocf, NULL);
+    am_presolve(solver, 1);
+    z = am_newvariable(solver);
+    x[0] = am_newvariable(solver);
+    new_constraint(solver, AM_REQUIRED, z, 1.0, AM_EQUAL, 42.0, END);
+    c = new_constraint(solver, AM_REQUIRED, x[0], 1.0, AM_EQUAL, 1.0, z, 1.0,
+                       END);
+    assert(solver->rows.count == 0);
+    am_resetsolver(solver, 1);
+    assert(!am_hasconstraint(c));
+    assert(am_approx(am_value(x[0]), 43.0));
+    assert(am_add(c) == AM_OK);
+    am_delvariable(z);
+    am_delvariable(x[0]);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_presolve passed\n");
+}
+
+static am_Solver *new_boxes(am_Variable **x, am_Constraint **gaps, int count,
+                            int native)
+{
+    am_Solver *solver = am_newsolver(debug_allocf, NULL);
+    int i;
+    am_autoupdate(solver, 1);
+    for (i = 0; i < count; ++i) {
+        x[i] = am_newvariable(solver);
+        if (native)
+            assert(am_setbounds(x[i], 0.0, 100.0, AM_REQUIRED) == AM_OK);
+        else {
+            new_constraint(solver, AM_REQUIRED, x[i], 1.0, AM_GREATEQUAL, 0.0,
+                           END);
+            new_constraint(solver, AM_REQUIRED, x[i], 1.0, AM_LESSEQUAL, 100.0,
+                           END);
+        }
+        new_constraint(solver, AM_WEAK, x[i], 1.0, AM_EQUAL, 30.0 * i, END);
+        if (i > 0)
+            gaps[i] = new_constraint(solver, AM_REQUIRED, x[i], 1.0,
+                                     AM_GREATEQUAL, 10.0, x[i - 1], 1.0, END);
+    }
+    return solver;
+}
+
+static void test_bounds()
+{
+    printf("test_bounds...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[8], *rx[8], *y;
+    am_Constraint *gaps[8], *rgaps[8], *c;
+    double values[] = { -50.0, 25.0, 90.0, 10.0, 40.0 };
+    int i, k;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = new_boxes(x, gaps, 8, 1);
+    ref = new_boxes(rx, rgaps, 8, 0);
+    assert(solver->rows.count + 16 == ref->rows.count);
+    assert(am_approx(am_value(x[7]), 100.0));
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    /* edits push the chain against both bounds */
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(rx[0], AM_STRONG);
+    for (k = 0; k < 5; ++k) {
+        am_suggest(x[0], values[k]);
+        am_suggest(rx[0], values[k]);
+        for (i = 0; i < 8; ++i) {
+            assert(am_value(x[i]) >= -1e-6 && am_value(x[i]) <= 100 + 1e-6);
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+        }
+    }
+    am_remove(gaps[4]);
+    am_remove(rgaps[4]);
+    am_suggest(x[0], 90.0);
+    am_suggest(rx[0], 90.0);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    am_add(gaps[4]);
+    am_add(rgaps[4]);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    /* changing bounds of a variable in the tableau */
+    assert(am_setbounds(x[7], 0.0, 200.0, AM_REQUIRED) == AM_OK);
+    am_delsolver(ref);
+    ref = new_boxes(rx, rgaps, 7, 0);
+    rx[7] = am_newvariable(ref);
+    new_constraint(ref, AM_REQUIRED, rx[7], 1.0, AM_GREATEQUAL, 0.0, END);
+    new_constraint(ref, AM_REQUIRED, rx[7], 1.0, AM_LESSEQUAL, 200.0, END);
+    new_constraint(ref, AM_WEAK, rx[7], 1.0, AM_EQUAL, 210.0, END);
+    new_constraint(ref, AM_REQUIRED, rx[7], 1.0, AM_GREATEQUAL, 10.0, rx[6],
+                   1.0, END);
+    am_addedit(rx[0], AM_STRONG);
+    am_suggest(rx[0], 90.0);
+    assert(am_approx(am_value(x[7]), 200.0));
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    ret = am_setbounds(x[7], 0.0, 50.0, AM_REQUIRED);
+    assert(ret == AM_UNSATISFIED || ret == AM_UNBOUND);
+    assert(am_approx(x[7]->upper, 200.0));
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    am_suggest(x[0], 0.0);
+    am_suggest(rx[0], 0.0);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    /* one-sided, soft and cleared bounds */
+    assert(am_setbounds(NULL, 0.0, 1.0, AM_REQUIRED) == AM_FAILED);
+    assert(am_setbounds(x[0], 1.0, 0.0, AM_REQUIRED) == AM_FAILED);
+    y = am_newvariable(solver);
+    assert(am_setbounds(y, -HUGE_VAL, 5.0, AM_REQUIRED) == AM_OK);
+    assert(am_approx(am_value(y), 5.0));
+    c = new_constraint(solver, AM_WEAK, y, 1.0, AM_EQUAL, 10.0, END);
+    assert(am_approx(am_value(y), 5.0));
+    assert(am_setbounds(y, 7.0, HUGE_VAL, AM_REQUIRED) == AM_OK);
+    assert(am_approx(am_value(y), 10.0));
+    assert(am_setbounds(y, 12.0, 20.0, AM_MEDIUM) == AM_OK);
+    assert(am_approx(am_value(y), 12.0));
+    assert(y->limits[0] != NULL && am_Symbol_id(y->bound) == 0);
+    assert(am_setbounds(y, -HUGE_VAL, HUGE_VAL, AM_REQUIRED) == AM_OK);
+    assert(am_approx(am_value(y), 10.0));
+    assert(y->limits[0] == NULL && am_Symbol_id(y->bound) == 0);
+    am_delconstraint(c);
+    am_delvariable(y);
+
+    am_delsolver(ref);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_bounds passed\n");
+}
+
+static int new_boxgroup(am_Solver *solver, am_Variable **x,
+                        am_Constraint **cons, int count)
+{
+    /* the constraints of new_boxes, built but not added */
+    int i, n = 0;
+    for (i = 0; i < count; ++i) {
+        x[i] = am_newvariable(solver);
+        cons[n++] = unadded_constraint(solver, AM_REQUIRED, x[i], 1.0,
+                                       AM_GREATEQUAL, 0.0, END);
+        cons[n++] = unadded_constraint(solver, AM_REQUIRED, x[i], 1.0,
+                                       AM_LESSEQUAL, 100.0, END);
+        cons[n++] = unadded_constraint(solver, AM_WEAK, x[i], 1.0, AM_EQUAL,
+                                       30.0 * i, END);
+        if (i > 0)
+            cons[n++] = unadded_constraint(solver, AM_REQUIRED, x[i], 1.0,
+                                           AM_GREATEQUAL, 10.0, x[i - 1], 1.0,
+                                           END);
+    }
+    return n;
+}
+
+static void test_addgroup()
+{
+    printf("test_addgroup...\n");
+    am_Solver *solver, *ref, *other;
+    am_Variable *x[8], *rx[8];
+    am_Constraint *cons[40], *rgaps[8], *bad[3];
+    double values[] = { -50.0, 25.0, 90.0 };
+    int i, k, n;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = am_newsolver(debug_allocf, NULL);
+    am_autoupdate(solver, 1);
+    n = new_boxgroup(solver, x, cons, 8);
+    ref = new_boxes(rx, rgaps, 8, 0);
+    assert(am_addgroup(cons, n) == AM_OK);
+    assert(solver->rows.count == ref->rows.count);
+    for (i = 0; i < n; ++i)
+        assert(am_hasconstraint(cons[i]));
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(rx[0], AM_STRONG);
+    for (k = 0; k < 3; ++k) {
+        am_suggest(x[0], values[k]);
+        am_suggest(rx[0], values[k]);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    }
+
+    /* the rest of a group goes in when some members can't */
+    other = am_newsolver(debug_allocf, NULL);
+    bad[0] = unadded_constraint(solver, AM_REQUIRED, x[7], 1.0, AM_LESSEQUAL,
+                                40.0, END);
+    bad[1] = unadded_constraint(solver, AM_REQUIRED, x[7], 1.0, AM_GREATEQUAL,
+                                95.0, END);
+    bad[2] = unadded_constraint(other, AM_REQUIRED, x[7], 1.0, AM_EQUAL, 0.0,
+                                END);
+    assert(am_addgroup(bad, 3) == AM_FAILED);
+    assert(!am_hasconstraint(bad[2]));
+    assert(am_hasconstraint(bad[0]) != am_hasconstraint(bad[1]));
+    assert(am_addgroup(cons, 1) == AM_FAILED);
+    assert(am_addgroup(NULL, 0) == AM_OK);
+    am_delconstraint(bad[0]);
+    am_delconstraint(bad[1]);
+    am_suggest(x[0], 0.0);
+    am_suggest(rx[0], 0.0);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    am_delsolver(other);
+    am_delsolver(ref);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_addgroup passed\n");
+}
+
+static int is_basic(am_Solver *solver, am_Variable *var)
+{
+    am_Row *row = NULL;
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        if (am_Symbol_id(am_key(row)) == am_Symbol_id(var->sym))
+            return 1;
+    return 0;
+}
+
+static void test_subject()
+{
+    printf("test_subject...\n");
+    am_Solver *solver;
+    am_Variable *p, *q, *r, *y[8];
+    int i;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    /* after y[i] == p + i, one of p and y[0] is mentioned by every row */
+    solver = am_newsolver(debug_allocf, NULL);
+    p = am_newvariable(solver);
+    for (i = 0; i < 8; ++i) {
+        y[i] = am_newvariable(solver);
+        new_constraint(solver, AM_REQUIRED, y[i], 1.0, AM_EQUAL, (double)i,
+                       p, 1.0, END);
+    }
+    q = am_newvariable(solver);
+    r = am_newvariable(solver);
+    new_constraint(solver, AM_REQUIRED, r, 1.0, AM_EQUAL, 0.0, p, 1.0, q, 1.0,
+                   END);
+    assert(is_basic(solver, q) || is_basic(solver, r));
+    assert(solver->rows.count == 9);
+    new_constraint(solver, AM_REQUIRED, q, 1.0, AM_EQUAL, 5.0, END);
+    am_updatevars(solver);
+    assert(am_approx(am_value(r), am_value(p) + 5.0));
+    assert(am_approx(am_value(y[7]), am_value(p) + 7.0));
+
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_subject passed\n");
+}
+
+static int same_basis(am_Solver *solver, am_Symbol *keys, size_t count)
+{
+    size_t i;
+    if (solver->rows.count != count)
+        return 0;
+    for (i = 0; i < count; ++i) {
+        am_Row *row = NULL;
+        while (am_nextentry(&solver->rows, (am_Entry **)&row))
+            if (am_Symbol_id(am_key(row)) == am_Symbol_id(keys[i]))
+                break;
+        if (row == NULL)
+            return 0;
+    }
+    return 1;
+}
+
+static void test_refactor()
+{
+    printf("test_refactor...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[8], *rx[8];
+    am_Constraint *gaps[8], *rgaps[8], *c;
+    am_Symbol keys[64];
+    am_Row *row = NULL;
+    size_t count = 0;
+    int i, k;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    /* bounds, an edit, a disabled and a redundant constraint */
+    solver = new_boxes(x, gaps, 8, 1);
+    ref = new_boxes(rx, rgaps, 8, 1);
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(rx[0], AM_STRONG);
+    c = new_constraint(solver, AM_MEDIUM, x[3], 1.0, AM_EQUAL, 20.0, END);
+    am_disable(c);
+    new_constraint(solver, AM_REQUIRED, x[5], 1.0, AM_EQUAL, 12.0, x[4],
+                   1.0, END);
+    new_constraint(solver, AM_REQUIRED, x[4], 2.0, AM_EQUAL, -24.0, x[5],
+                   2.0, END);
+    new_constraint(ref, AM_REQUIRED, rx[5], 1.0, AM_EQUAL, 12.0, rx[4], 1.0,
+                   END);
+    am_suggest(x[0], 90.0);
+    am_suggest(rx[0], 90.0);
+
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        keys[count++] = am_key(row);
+    assert(am_refactor(solver) == AM_OK);
+    assert(same_basis(solver, keys, count));
+    assert(solver->pivot_count == 0);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    /* automatic refactoring keeps the same solutions */
+    am_autorefactor(solver, 16);
+    for (k = 0; k < 20; ++k) {
+        am_suggest(x[0], (k % 3) * 40.0 - 20.0);
+        am_suggest(rx[0], (k % 3) * 40.0 - 20.0);
+        assert(solver->pivot_count < 16 + solver->rows.count);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    }
+    am_enable(c);
+    assert(am_approx(am_value(x[3]), 20.0) || am_value(x[3]) > 20.0);
+    assert(am_refactor(NULL) == AM_FAILED);
+
+    am_delsolver(ref);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_refactor passed\n");
+}
+
+static void test_refactor_rebuild()
+{
+    printf("test_refactor_rebuild...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[12], *rx[12];
+    am_Constraint *c;
+    int i, k;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    /* the last constraint contradicts the second; adding it pivots enough
+     * to refactor, the refactor falls back to a rebuild and the rebuild
+     * drops a constraint again, which must not start another refactor */
+    solver = am_newsolver(debug_allocf, NULL);
+    ref = am_newsolver(debug_allocf, NULL);
+    am_autorefactor(solver, 3);
+    for (k = 0; k < 2; ++k) {
+        am_Solver *s = k ? ref : solver;
+        am_Variable **v = k ? rx : x;
+        for (i = 0; i < 12; ++i)
+            v[i] = am_newvariable(s);
+        new_constraint(s, AM_WEAK, v[4], 1.0, AM_LESSEQUAL, 31.0, v[3], 2.0,
+                       END);
+        new_constraint(s, AM_REQUIRED, v[10], 1.0, AM_LESSEQUAL, 13.0, v[10],
+                       -1.0, END);
+        new_constraint(s, AM_STRONG, v[11], 1.0, AM_EQUAL, 92.0, v[3], 1.0,
+                       END);
+        new_constraint(s, AM_REQUIRED, v[9], 1.0, AM_GREATEQUAL, 5.0, v[11],
+                       2.0, END);
+        new_constraint(s, AM_STRONG, v[8], 1.0, AM_LESSEQUAL, 39.0, END);
+        new_constraint(s, AM_REQUIRED, v[10], 1.0, AM_LESSEQUAL, 1.0, v[9],
+                       2.0, END);
+        new_constraint(s, AM_REQUIRED, v[3], 1.0, AM_GREATEQUAL, 56.0, v[9],
+                       2.0, END);
+        new_constraint(s, AM_WEAK, v[5], 1.0, AM_LESSEQUAL, 96.0, v[2], -2.0,
+                       END);
+        c = am_newconstraint(s, AM_REQUIRED);
+        am_addterm(c, v[10], 2.0);
+        am_setrelation(c, AM_EQUAL);
+        am_addconstant(c, 30.0);
+        assert(am_add(c) == AM_UNBOUND);
+        assert(!am_hasconstraint(c));
+        am_updatevars(s);
+    }
+    assert(!solver->refactoring);
+    assert(solver->pivot_count < 3 + solver->rows.count);
+    for (i = 0; i < 12; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    am_delsolver(ref);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_refactor_rebuild passed\n");
+}
+
+static int index_matches(am_Solver *solver)
+{
+    am_Row *row = NULL;
+    am_Column *col = NULL;
+    size_t terms = 0, links = 0;
+    while (am_nextentry(&solver->rows, (am_Entry **)&row)) {
+        am_Term *term = NULL;
+        while (am_nextentry(&row->terms, (am_Entry **)&term)) {
+            am_Entry *link = NULL;
+            ++terms;
+            col = NULL;
+            while (am_nextentry(&solver->columns, (am_Entry **)&col))
+                if (am_Symbol_id(am_key(col)) == am_Symbol_id(am_key(term)))
+                    break;
+            if (col == NULL)
+                return 0;
+            while (am_nextentry(&col->rows, &link))
+                if (am_Symbol_id(am_key(link)) == am_Symbol_id(am_key(row)))
+                    break;
+            if (link == NULL)
+                return 0;
+        }
+    }
+    col = NULL;
+    while (am_nextentry(&solver->columns, (am_Entry **)&col))
+        links += col->rows.count;
+    return links == terms;
+}
+
+static void test_columnindex()
+{
+    printf("test_columnindex...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[8], *rx[8];
+    am_Constraint *gaps[8], *rgaps[8];
+    int i, k;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    /* indexing an existing tableau, then solving alongside a plain one */
+    solver = new_boxes(x, gaps, 8, 1);
+    ref = new_boxes(rx, rgaps, 8, 1);
+    am_columnindex(solver, 1);
+    assert(solver->indexed && index_matches(solver));
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(rx[0], AM_STRONG);
+    for (k = 0; k < 12; ++k) {
+        am_suggest(x[0], (k % 4) * 35.0 - 30.0);
+        am_suggest(rx[0], (k % 4) * 35.0 - 30.0);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    }
+    assert(index_matches(solver));
+
+    /* removal, artificial adds and refactoring keep the index in step */
+    am_remove(gaps[3]);
+    am_remove(rgaps[3]);
+    am_add(gaps[3]);
+    am_add(rgaps[3]);
+    new_constraint(solver, AM_REQUIRED, x[6], 1.0, AM_EQUAL, 40.0, x[2], 1.0,
+                   END);
+    new_constraint(ref, AM_REQUIRED, rx[6], 1.0, AM_EQUAL, 40.0, rx[2], 1.0,
+                   END);
+    am_suggest(x[0], 45.0);
+    am_suggest(rx[0], 45.0);
+    assert(index_matches(solver));
+    assert(am_refactor(solver) == AM_OK);
+    assert(index_matches(solver));
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    am_columnindex(solver, 0);
+    assert(!solver->indexed && solver->columns.count == 0);
+    am_suggest(x[0], 10.0);
+    am_suggest(rx[0], 10.0);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    am_columnindex(solver, 1);
+    am_remove(gaps[5]);
+    am_remove(rgaps[5]);
+    am_suggest(x[0], 60.0);
+    am_suggest(rx[0], 60.0);
+    assert(index_matches(solver));
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    am_delsolver(ref);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_columnindex passed\n");
+}
+
+typedef struct Sweep {
+    int count;
+    am_Float from[64], to[64], values[64][4], slopes[64][4];
+} Sweep;
+
+static void on_piece(void *ud, am_Float from, am_Float to,
+                     const am_Float *values, const am_Float *slopes)
+{
+    Sweep *sw = (Sweep *)ud;
+    int i;
+    assert(sw->count < 64);
+    sw->from[sw->count] = from, sw->to[sw->count] = to;
+    for (i = 0; i < 4; ++i) {
+        sw->values[sw->count][i] = values[i];
+        sw->slopes[sw->count][i] = slopes[i];
+    }
+    ++sw->count;
+}
+
+static void check_sweep(Sweep *sw, am_Variable *edit, am_Variable **vars,
+                        am_Float from, am_Float to)
+{
+    int i, k, n;
+    assert(sw->count > 0 && sw->from[0] == from);
+    assert(sw->to[sw->count - 1] == to);
+    for (k = 0; k < sw->count; ++k) {
+        if (k > 0)
+            assert(sw->from[k] == sw->to[k - 1]);
+        for (n = 0; n <= 4; ++n) {
+            am_Float t = sw->from[k] + (sw->to[k] - sw->from[k]) * n / 4;
+            am_suggest(edit, t);
+            for (i = 0; i < 4; ++i)
+                assert(am_approx(am_value(vars[i]), sw->values[k][i]
+                                 + sw->slopes[k][i] * (t - sw->from[k])));
+        }
+    }
+}
+
+static void test_sweep()
+{
+    printf("test_sweep...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[8], *rx[8], *vars[4], *rvars[4];
+    am_Constraint *gaps[8], *rgaps[8];
+    Sweep sw;
+    int i, native;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    /* pieces agree with solving at points inside them, both ways */
+    for (native = 0; native < 2; ++native) {
+        solver = new_boxes(x, gaps, 8, native);
+        ref = new_boxes(rx, rgaps, 8, native);
+        for (i = 0; i < 4; ++i)
+            vars[i] = x[2 * i + 1], rvars[i] = rx[2 * i + 1];
+        am_addedit(x[0], AM_STRONG);
+        am_addedit(rx[0], AM_STRONG);
+        sw.count = 0;
+        assert(am_sweep(x[0], -50.0, 150.0, vars, 4, on_piece, &sw) == AM_OK);
+        assert(sw.count > 1 && sw.count < 16);
+        assert(am_approx(am_value(x[0]), 30.0));
+        check_sweep(&sw, rx[0], rvars, -50.0, 150.0);
+        sw.count = 0;
+        assert(am_sweep(x[0], 120.0, 5.0, vars, 4, on_piece, &sw) == AM_OK);
+        check_sweep(&sw, rx[0], rvars, 120.0, 5.0);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+        am_delsolver(ref);
+        am_delsolver(solver);
+    }
+
+    /* a single point is one empty piece; a budget stops at a breakpoint */
+    solver = new_boxes(x, gaps, 8, 1);
+    for (i = 0; i < 4; ++i)
+        vars[i] = x[2 * i + 1];
+    sw.count = 0;
+    assert(am_sweep(x[0], 40.0, 40.0, vars, 4, on_piece, &sw) == AM_OK);
+    assert(sw.count == 1 && sw.from[0] == 40.0 && sw.to[0] == 40.0);
+    assert(am_approx(sw.values[0][0], am_value(x[1])));
+    assert(sw.slopes[0][0] == 0.0);
+    am_suggest(x[0], 0.0);
+    am_setbudget(solver, 1);
+    sw.count = 0;
+    assert(am_sweep(x[0], 0.0, 100.0, vars, 4, on_piece, &sw)
+           == AM_INCOMPLETE);
+    assert(sw.count == 2 && sw.to[1] < 100.0);
+    am_setbudget(solver, 0);
+    assert(am_sweep(NULL, 0.0, 1.0, vars, 4, on_piece, &sw) == AM_FAILED);
+    assert(am_sweep(x[0], 0.0, 1.0, vars, 4, NULL, &sw) == AM_FAILED);
+
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_sweep passed\n");
+}
+
+static void test_sense()
+{
+    printf("test_sense...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[8], *rx[8];
+    am_Constraint *gaps[8], *rgaps[8], *edit;
+    unsigned revision;
+    int i, k;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    /* drags that need no pivot reuse the cached column */
+    solver = am_newsolver(debug_allocf, NULL);
+    am_autoupdate(solver, 1);
+    for (i = 0; i < 8; ++i) {
+        x[i] = am_newvariable(solver);
+        new_constraint(solver, AM_WEAK, x[i], 1.0, AM_EQUAL, 100.0, END);
+        if (i > 0)
+            new_constraint(solver, AM_REQUIRED, x[i], 1.0, AM_EQUAL, 10.0,
+                           x[i - 1], 1.0, END);
+    }
+    am_addedit(x[0], AM_STRONG);
+    edit = x[0]->constraint;
+    am_suggest(x[0], 10.0);
+    am_suggest(x[0], 12.0);
+    revision = solver->revision;
+    assert(edit->sense_revision == revision && edit->sense_count >= 8);
+    for (k = 0; k < 10; ++k) {
+        am_suggest(x[0], 10.0 + k * 0.5);
+        assert(solver->revision == revision);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), 10.0 * (i + 1) + k * 0.5));
+    }
+    am_delsolver(solver);
+    solver = new_boxes(x, gaps, 8, 0);
+    am_addedit(x[0], AM_STRONG);
+
+    /* pivots and new rows rebuild it; results match a fresh solver */
+    for (k = 0; k < 12; ++k) {
+        am_Float value = (k % 4) * 35.0 - 30.0;
+        if (k == 5)
+            new_constraint(solver, AM_REQUIRED, x[4], 1.0, AM_GREATEQUAL,
+                           15.0, x[3], 1.0, END);
+        if (k == 8)
+            am_remove(gaps[2]);
+        am_suggest(x[0], value);
+        ref = new_boxes(rx, rgaps, 8, 0);
+        if (k >= 5)
+            new_constraint(ref, AM_REQUIRED, rx[4], 1.0, AM_GREATEQUAL, 15.0,
+                           rx[3], 1.0, END);
+        if (k >= 8)
+            am_remove(rgaps[2]);
+        am_addedit(rx[0], AM_STRONG);
+        am_suggest(rx[0], value);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+        am_delsolver(ref);
+    }
+    am_deledit(x[0]);
+
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_sense passed\n");
+}
+
+static void test_memo()
+{
+    printf("test_memo...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[8], *rx[8];
+    am_Constraint *gaps[8], *rgaps[8];
+    am_Float sizes[] = { -30.0, 80.0, -30.0, 80.0, -30.0, 80.0, -30.0 };
+    size_t hits, misses, count;
+    Sweep sw;
+    int i, k;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    /* toggling between a few states hits once each has been solved */
+    solver = new_boxes(x, gaps, 8, 0);
+    ref = new_boxes(rx, rgaps, 8, 0);
+    am_memoize(solver, 4);
+    am_addedit(x[0], AM_STRONG);
+    am_addedit(rx[0], AM_STRONG);
+    for (k = 0; k < 7; ++k) {
+        am_suggest(x[0], sizes[k]);
+        am_suggest(rx[0], sizes[k]);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    }
+    am_memostats(solver, &hits, &misses);
+    assert(hits == 4 && misses == 2);
+
+    /* a constraint change leaves the old states behind */
+    new_constraint(solver, AM_REQUIRED, x[2], 1.0, AM_GREATEQUAL, 50.0, END);
+    new_constraint(ref, AM_REQUIRED, rx[2], 1.0, AM_GREATEQUAL, 50.0, END);
+    am_suggest(x[0], 80.0);
+    am_suggest(rx[0], 80.0);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+    am_memostats(solver, &count, NULL);
+    assert(count == hits);
+    am_suggest(x[0], -30.0);
+    am_suggest(x[0], 80.0);
+    am_memostats(solver, &count, NULL);
+    assert(count == hits + 1);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    /* a sweep solves the rows a hit left pending; so does turning it off */
+    am_suggest(x[0], -30.0);
+    am_suggest(rx[0], -30.0);
+    sw.count = 0;
+    assert(am_sweep(x[0], -30.0, -30.0, x + 1, 4, on_piece, &sw) == AM_OK);
+    for (i = 0; i < 4; ++i)
+        assert(am_approx(sw.values[0][i], am_value(rx[i + 1])));
+    am_suggest(x[0], 80.0);
+    am_memoize(solver, 0);
+    am_suggest(x[0], 45.0);
+    am_suggest(rx[0], 45.0);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), am_value(rx[i])));
+
+    am_delsolver(ref);
+    am_delsolver(solver);
+
+    /* hits wait for am_updatevars, and reach the solvers that follow */
+    solver = new_boxes(x, gaps, 8, 0);
+    ref = am_newsolver(debug_allocf, NULL);
+    am_memoize(solver, 4);
+    am_addedit(x[0], AM_STRONG);
+    rx[0] = am_newvariable(ref);
+    rx[1] = am_newvariable(ref);
+    new_constraint(ref, AM_REQUIRED, rx[1], 1.0, AM_EQUAL, 7.0, rx[0], 1.0,
+                   END);
+    assert(am_bind(rx[0], x[1], AM_STRONG) == AM_OK);
+    for (k = 0; k < 4; ++k) {
+        am_suggest(x[0], sizes[k]);
+        am_updatevars(ref);
+        assert(am_approx(am_value(rx[0]), am_value(x[1])));
+        assert(am_approx(am_value(rx[1]), am_value(x[1]) + 7.0));
+    }
+    am_memostats(solver, &hits, NULL);
+    assert(hits == 1 && am_approx(am_value(x[1]), 40.0));
+    am_autoupdate(solver, 0);
+    am_suggest(x[0], sizes[2]);
+    am_memostats(solver, &hits, NULL);
+    assert(hits == 2 && am_approx(am_value(x[1]), 40.0));
+    am_updatevars(solver);
+    assert(am_approx(am_value(x[1]), 30.0));
+    am_updatevars(ref);
+    assert(am_approx(am_value(rx[1]), 37.0));
+
+    am_delsolver(ref);
+    am_delsolver(solver);
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_memo passed\n");
+}
+
+static void test_freeze()
+{
+    printf("test_freeze...\n");
+    am_Solver *solver, *ref;
+    am_Variable *x[8], *rx[8];
+    am_Constraint *gaps[8], *rgaps[8], *c;
+    am_Float values[8];
+    size_t rows;
+    int i, native;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    for (native = 0; native < 2; ++native) {
+        solver = new_boxes(x, gaps, 8, native);
+        ref = new_boxes(rx, rgaps, 8, native);
+        am_suggest(x[0], 20.0);
+        am_suggest(rx[0], 20.0);
+        for (i = 0; i < 8; ++i)
+            values[i] = am_value(x[i]);
+        rows = solver->rows.count;
+
+        /* the frozen part keeps its values and leaves the tableau */
+        assert(am_freeze(x, 6) == AM_OK);
+        assert(solver->rows.count < rows);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), values[i]));
+        am_suggest(x[0], 60.0);
+        am_suggest(x[7], 10.0);
+        for (i = 0; i < 6; ++i)
+            assert(am_approx(am_value(x[i]), values[i]));
+        assert(am_value(x[6]) >= values[5] + 10.0 - 1e-6);
+        assert(am_value(x[7]) >= am_value(x[6]) + 10.0 - 1e-6);
+
+        /* constraints among frozen variables are only checked */
+        c = new_constraint(solver, AM_WEAK, x[2], 1.0, AM_EQUAL, 0.0, END);
+        assert(am_hasconstraint(c));
+        c = am_newconstraint(solver, AM_REQUIRED);
+        am_addterm(c, x[3], 1.0);
+        am_setrelation(c, AM_LESSEQUAL);
+        am_addterm(c, x[2], 1.0);
+        assert(am_add(c) == AM_UNSATISFIED);
+        am_delconstraint(c);
+        am_remove(gaps[3]);
+        am_remove(rgaps[3]);
+        assert(am_approx(am_value(x[3]), values[3]));
+
+        /* thawing solves them again with everything else */
+        am_suggest(rx[0], 60.0);
+        am_suggest(rx[7], 10.0);
+        new_constraint(ref, AM_WEAK, rx[2], 1.0, AM_EQUAL, 0.0, END);
+        assert(am_thaw(x, 6) == AM_OK);
+        assert(solver->frozen_count == 0);
+        for (i = 0; i < 8; ++i)
+            assert(am_approx(am_value(x[i]), am_value(rx[i])));
+        am_delsolver(ref);
+        am_delsolver(solver);
+    }
+    assert(am_freeze(NULL, 0) == AM_OK);
+    assert(am_freeze(x, 0) == AM_OK);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_freeze passed\n");
+}
+
+static int holds(am_Variable *a, am_Variable *b, double gap)
+{
+    return am_value(a) >= am_value(b) + gap - 1e-6;
+}
+
+static void test_diffsolve()
+{
+    printf("test_diffsolve...\n");
+    am_Solver *solver;
+    am_Variable *x[8], *y;
+    am_Constraint *gaps[8], *c;
+    int i;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = am_newsolver(debug_allocf, NULL);
+    am_autoupdate(solver, 1);
+    am_diffsolve(solver, 1);
+    for (i = 0; i < 8; ++i) {
+        x[i] = am_newvariable(solver);
+        if (i > 0)
+            gaps[i] = new_constraint(solver, AM_REQUIRED, x[i], 1.0,
+                                     AM_GREATEQUAL, 10.0, x[i - 1], 1.0, END);
+    }
+    y = am_newvariable(solver);
+    new_constraint(solver, AM_REQUIRED, y, 1.0, AM_EQUAL, 5.0, x[3], 1.0, END);
+
+    /* a chain of gaps packs from 0 without a row in the tableau */
+    assert(solver->rows.count == 0);
+    assert(solver->diffnodes.count == 9);
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), 10.0 * i));
+    assert(am_approx(am_value(y), 35.0));
+
+    /* a positive cycle is rejected and leaves the values alone */
+    c = am_newconstraint(solver, AM_REQUIRED);
+    am_addterm(c, x[0], 1.0);
+    am_setrelation(c, AM_GREATEQUAL);
+    am_addterm(c, x[7], 1.0);
+    am_addconstant(c, 1.0);
+    assert(am_add(c) == AM_UNSATISFIED);
+    assert(!am_hasconstraint(c));
+    for (i = 0; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), 10.0 * i));
+
+    /* removing a gap lowers what it was pushing */
+    am_remove(gaps[3]);
+    for (i = 3; i < 8; ++i)
+        assert(am_approx(am_value(x[i]), 10.0 * (i - 3)));
+    assert(am_approx(am_value(y), 5.0));
+
+    /* an edit moves the component it touches into the tableau */
+    am_suggest(x[5], 50.0);
+    assert(x[5]->intableau && !x[6]->indiff && x[1]->indiff);
+    assert(am_approx(am_value(x[5]), 50.0));
+    assert(holds(x[6], x[5], 10.0) && holds(x[7], x[6], 10.0));
+    assert(holds(x[5], x[4], 10.0));
+    assert(am_approx(am_value(x[2]), 20.0));
+
+    /* switching it off leaves the tableau to solve everything */
+    am_diffsolve(solver, 0);
+    assert(solver->diffnodes.count == 0);
+    for (i = 1; i < 8; ++i)
+        assert(i == 3 || holds(x[i], x[i - 1], 10.0));
+    assert(am_approx(am_value(y), am_value(x[3]) + 5.0));
+    assert(am_add(c) == AM_OK);
+    assert(holds(x[0], x[7], -1.0));
+    am_delsolver(solver);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_diffsolve passed\n");
+}
+
+static void test_nested()
+{
+    printf("test_nested...\n");
+    am_Solver *parent, *child, *grand;
+    am_Variable *left, *width, *other, *l, *w, *a, *b, *g;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    parent = am_newsolver(debug_allocf, NULL);
+    child = am_newsolver(debug_allocf, NULL);
+    grand = am_newsolver(debug_allocf, NULL);
+    left = am_newvariable(parent);
+    width = am_newvariable(parent);
+    other = am_newvariable(parent);
+    new_constraint(parent, AM_REQUIRED, width, 1.0, AM_GREATEQUAL, 40.0, END);
+    new_constraint(parent, AM_REQUIRED, left, 1.0, AM_EQUAL, 10.0, END);
+    am_suggest(width, 100.0);
+    am_suggest(other, 1.0);
+
+    /* the child lays out two boxes inside the span it gets */
+    l = am_newvariable(child);
+    w = am_newvariable(child);
+    a = am_newvariable(child);
+    b = am_newvariable(child);
+    new_constraint(child, AM_REQUIRED, a, 1.0, AM_GREATEQUAL, 5.0, l, 1.0, END);
+    new_constraint(child, AM_REQUIRED, b, 1.0, AM_GREATEQUAL, 10.0, a, 1.0, END);
+    new_constraint(child, AM_REQUIRED, b, 1.0, AM_LESSEQUAL, -5.0, l, 1.0,
+                   w, 1.0, END);
+    new_constraint(child, AM_WEAK, b, 1.0, AM_EQUAL, -5.0, l, 1.0, w, 1.0,
+                   END);
+    assert(am_bind(l, left, AM_STRONG) == AM_OK);
+    assert(am_bind(w, width, AM_STRONG) == AM_OK);
+    assert(am_bind(w, width, AM_STRONG) == AM_FAILED);
+    assert(am_bind(left, a, AM_STRONG) == AM_FAILED); /* a cycle */
+    assert(child->parent == parent && parent->children == child);
+
+    g = am_newvariable(grand);
+    assert(am_bind(g, b, AM_STRONG) == AM_OK);
+    assert(am_bind(am_newvariable(grand), other, AM_STRONG) == AM_FAILED);
+
+    am_updatevars(grand);
+    assert(am_approx(am_value(l), 10.0) && am_approx(am_value(w), 100.0));
+    assert(am_approx(am_value(b), 105.0) && am_approx(am_value(g), 105.0));
+
+    /* children only catch up when their values are asked for */
+    am_suggest(width, 60.0);
+    am_updatevars(parent);
+    assert(child->stale && am_approx(am_value(b), 105.0));
+    am_updatevars(grand);
+    assert(!child->stale && !grand->stale);
+    assert(am_approx(am_value(w), 60.0) && am_approx(am_value(g), 65.0));
+
+    /* values nothing follows leave them alone */
+    am_suggest(other, 2.0);
+    am_updatevars(parent);
+    assert(!child->stale);
+
+    am_unbind(g);
+    assert(grand->parent == NULL && child->children == NULL);
+    assert(!am_hasedit(g));
+    am_delsolver(grand);
+
+    /* a child outlives its parent, keeping the last values */
+    am_delsolver(parent);
+    assert(child->parent == NULL && l->source == NULL);
+    am_updatevars(child);
+    assert(am_approx(am_value(w), 60.0));
+    am_delsolver(child);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_nested passed\n");
+}
+
+static void test_health()
+{
+    printf("test_health...\n");
+    am_Solver *solver;
+    am_Variable *x[8];
+    am_Constraint *gaps[8];
+    am_Health health;
+    am_Stats stats, after;
+    am_Row *row = NULL;
+    am_Term *term = NULL;
+    size_t i, rows = 0, columns = 0, longest = 0, basic = 0;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    assert(am_gethealth(NULL, &health) == AM_FAILED);
+    solver = am_newsolver(debug_allocf, NULL);
+    assert(am_gethealth(solver, &health) == AM_OK);
+    assert(health.rows == 0 && health.columns == 0);
+    assert(health.min_coefficient == 0.0 && health.max_coefficient == 0.0);
+    am_delsolver(solver);
+
+    solver = new_boxes(x, gaps, 8, 0);
+    am_suggest(x[3], 45.0);
+    am_getstats(solver, &stats);
+    assert(am_gethealth(solver, &health) == AM_OK);
+    am_getstats(solver, &after);
+    assert(memcmp(&stats, &after, sizeof(stats)) == 0);
+
+    assert(health.rows == stats.rows && health.nonzeros == stats.nonzeros);
+    assert(health.objective_terms == stats.objective_terms);
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        if (row->terms.count > longest)
+            longest = row->terms.count;
+    assert(health.max_row_length == longest);
+    for (i = 0; i < AM_HEALTH_BUCKETS; ++i) {
+        rows += health.row_lengths[i];
+        columns += health.column_counts[i];
+    }
+    for (i = 0; i < 4; ++i)
+        basic += health.basic[i];
+    assert(rows == health.rows && basic == health.rows);
+    assert(columns == health.columns && health.columns > 0);
+    assert(health.max_column_count <= health.rows);
+    assert(health.basic[0] == 8); /* every box position is basic */
+
+    /* the objective's terms are among the coefficients too */
+    while (am_nextentry(&solver->objective.terms, (am_Entry **)&term)) {
+        am_Float m = term->multiplier < 0 ? -term->multiplier
+                                          : term->multiplier;
+        assert(health.min_coefficient <= m && m <= health.max_coefficient);
+    }
+    assert(health.min_coefficient > 0.0);
+    assert(health.max_coefficient >= AM_MEDIUM);
+    am_delsolver(solver);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_health passed\n");
+}
+
+static void test_stats()
+{
+    printf("test_stats...\n");
+    am_Solver *solver;
+    am_Variable *x[8];
+    am_Constraint *gaps[8];
+    am_Stats stats;
+    size_t nonzeros = 0;
+    am_Row *row = NULL;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    assert(am_getstats(NULL, &stats) == AM_FAILED);
+    solver = new_boxes(x, gaps, 8, 0);
+    ret = am_getstats(solver, &stats);
+    while (am_nextentry(&solver->rows, (am_Entry **)&row))
+        nonzeros += row->terms.count;
+    assert(stats.rows == solver->rows.count && stats.nonzeros == nonzeros);
+    assert(stats.objective_terms == solver->objective.terms.count);
+#ifdef AM_USE_STATS
+    assert(ret == AM_OK);
+    assert(stats.bytes_allocated == allmem);
+    assert(stats.table_resizes > 0 && stats.rows_scanned > 0);
+    assert(stats.rows_modified <= stats.rows_scanned);
+
+    /* counters start over, the allocation total doesn't */
+    am_resetstats(solver);
+    am_suggest(x[0], 90.0);
+    am_getstats(solver, &stats);
+    assert(stats.dual_pivots > 0);
+    assert(stats.rows_scanned > 0 && stats.artificials == 0);
+    assert(stats.bytes_allocated == allmem);
+#else
+    assert(ret == AM_FAILED);
+    assert(stats.primal_pivots == 0 && stats.bytes_allocated == 0);
+    am_resetstats(solver);
+#endif
+    am_delsolver(solver);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_stats passed\n");
+}
+
+typedef struct TraceLog {
+    int depth;
+    size_t begins[4], ends[4], pivots[4];
+} TraceLog;
+
+static void trace_log(void *ud, const am_TraceEvent *ev)
+{
+    TraceLog *log = (TraceLog *)ud;
+    assert(ev->what > 0 && ev->what < 4);
+    if (ev->kind == AM_TRACE_BEGIN)
+        ++log->begins[ev->what], ++log->depth;
+    else if (ev->kind == AM_TRACE_END) {
+        ++log->ends[ev->what];
+        assert(--log->depth >= 0);
+    }
+    else {
+        assert(ev->kind == AM_TRACE_PIVOT);
+        assert(ev->entering != 0 && ev->leaving != 0);
+        assert(ev->row_terms > 0 && ev->rows > 0);
+        ++log->pivots[ev->what];
+    }
+}
+
+static size_t read_trace(const char *path, char *buf, size_t size)
+{
+    FILE *fp = fopen(path, "r");
+    size_t n;
+    assert(fp != NULL);
+    n = fread(buf, 1, size - 1, fp);
+    buf[n] = '\0';
+    fclose(fp);
+    remove(path);
+    return n;
+}
+
+static void test_trace()
+{
+    printf("test_trace...\n");
+    am_Solver *solver;
+    am_Variable *x[8];
+    am_Constraint *gaps[8];
+    TraceLog log;
+    static char buf[65536];
+    size_t n;
+    int ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    memset(&log, 0, sizeof(log));
+    solver = new_boxes(x, gaps, 8, 0);
+    am_settrace(solver, trace_log, &log);
+    am_suggest(x[0], 90.0);
+    assert(log.begins[AM_TRACE_SUGGEST] == 1 && log.ends[AM_TRACE_SUGGEST] == 1);
+    assert(log.begins[AM_TRACE_ADD] == 1 && log.ends[AM_TRACE_ADD] == 1);
+    assert(log.pivots[AM_TRACE_DUAL] > 0 && log.depth == 0);
+    am_remove(gaps[3]);
+    assert(log.begins[AM_TRACE_REMOVE] == 1 && log.ends[AM_TRACE_REMOVE] == 1);
+    am_remove(gaps[3]); /* not in the solver, nothing happens */
+    assert(log.begins[AM_TRACE_REMOVE] == 1 && log.depth == 0);
+
+    /* unset, nothing is reported */
+    am_settrace(solver, NULL, NULL);
+    am_suggest(x[0], 10.0);
+    assert(log.begins[AM_TRACE_SUGGEST] == 1);
+
+    /* the Chrome sink balances its array, also when the solver goes */
+    assert(am_tracefile(solver, "am_trace_test.json") == AM_OK);
+    am_suggest(x[0], 60.0);
+    assert(am_add(gaps[3]) == AM_OK);
+    assert(am_tracefile(solver, NULL) == AM_OK);
+    n = read_trace("am_trace_test.json", buf, sizeof(buf));
+    assert(n > 4 && buf[0] == '[' && strcmp(buf + n - 4, "}\n]\n") == 0);
+    assert(strstr(buf, "\"name\":\"am_suggest\",\"ph\":\"B\"") != NULL);
+    assert(strstr(buf, "\"name\":\"am_add\",\"ph\":\"E\"") != NULL);
+    assert(strstr(buf, "\"name\":\"pivot\",\"cat\":\"dual\",\"ph\":\"X\"") !=
+           NULL);
+    assert(strstr(buf, "\"dur\":") != NULL);
+    assert(am_tracefile(solver, "am_trace_test.json") == AM_OK);
+    am_delsolver(solver);
+    n = read_trace("am_trace_test.json", buf, sizeof(buf));
+    assert(strcmp(buf, "[\n\n]\n") == 0);
+    assert(am_tracefile(NULL, "am_trace_test.json") == AM_FAILED);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_trace passed\n");
+}
+
+typedef struct ReplayLog {
+    int open;
+    size_t calls, adds, suggests;
+} ReplayLog;
+
+static void replay_log(void *ud, const char *call, int done)
+{
+    ReplayLog *log = (ReplayLog *)ud;
+    assert(call != NULL && log->open == done);
+    log->open = !done;
+    if (!done)
+        ++log->calls;
+    if (!done && strcmp(call, "am_add") == 0)
+        ++log->adds;
+    if (!done && strcmp(call, "am_suggest") == 0)
+        ++log->suggests;
+}
+
+static void ignore_piece(void *ud, am_Float from, am_Float to,
+                         const am_Float *values, const am_Float *slopes)
+{
+    (void)ud, (void)from, (void)to, (void)values, (void)slopes;
+}
+
+static int replay_bytes(const unsigned char *calls, size_t n, size_t *vars)
+{
+    /* replays the calls after the header on a new solver */
+    am_Solver *solver = am_newsolver(debug_allocf, NULL);
+    FILE *fp = fopen("am_record_test.amrc", "wb");
+    int ret;
+    fwrite("AMRC\1", 1, 5, fp);
+    fwrite(calls, 1, n, fp);
+    fclose(fp);
+    ret = am_replay(solver, "am_record_test.amrc", NULL, NULL);
+    if (vars != NULL)
+        *vars = solver->vars.count;
+    am_delsolver(solver);
+    return ret;
+}
+
+static void test_latency()
+{
+    printf("test_latency...\n");
+    am_Solver *solver;
+    am_Variable *x[8];
+    am_Constraint *gaps[8];
+    am_Latency lat;
+    int i, ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = new_boxes(x, gaps, 8, 0);
+    assert(am_getlatency(solver, AM_LAT_ADD, &lat) == AM_FAILED);
+    assert(lat.count == 0 && lat.max == 0.0);
+#ifdef AM_USE_STATS
+    assert(am_latency(solver, 1) == AM_OK);
+    assert(am_getlatency(solver, AM_LAT_OPS, &lat) == AM_FAILED);
+    for (i = 0; i < 100; ++i)
+        am_suggest(x[0], 10.0 + i);
+    am_updatevars(solver);
+    am_remove(gaps[3]);
+    am_add(gaps[3]);
+
+    /* am_suggest adds an edit on its first call, timed only once */
+    assert(am_getlatency(solver, AM_LAT_SUGGEST, &lat) == AM_OK);
+    assert(lat.count == 100 && lat.max > 0.0);
+    assert(lat.p50 <= lat.p99 && lat.p99 <= lat.p999 && lat.p999 <= lat.max);
+    am_getlatency(solver, AM_LAT_ADD, &lat);
+    assert(lat.count == 1 && lat.p50 == lat.p999);
+    am_getlatency(solver, AM_LAT_REMOVE, &lat);
+    assert(lat.count == 1);
+    am_getlatency(solver, AM_LAT_UPDATEVARS, &lat);
+    assert(lat.count == 1);
+    am_getlatency(solver, AM_LAT_SETSTRENGTH, &lat);
+    assert(lat.count == 0 && lat.p50 == 0.0);
+
+    am_resetlatency(solver);
+    am_getlatency(solver, AM_LAT_SUGGEST, &lat);
+    assert(lat.count == 0 && lat.max == 0.0);
+    am_setstrength(gaps[1], AM_WEAK);
+    am_getlatency(solver, AM_LAT_SETSTRENGTH, &lat);
+    assert(lat.count == 1);
+
+    /* switching off frees the histograms, the solver keeps the rest */
+    am_latency(solver, 0);
+    assert(am_getlatency(solver, AM_LAT_SETSTRENGTH, &lat) == AM_FAILED);
+    am_latency(solver, 1);
+#else
+    assert(am_latency(solver, 1) == AM_FAILED);
+    for (i = 0; i < 4; ++i)
+        am_suggest(x[0], 10.0 + i);
+    assert(am_getlatency(solver, AM_LAT_SUGGEST, &lat) == AM_FAILED);
+    am_resetlatency(solver);
+#endif
+    am_delsolver(solver);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_latency passed\n");
+}
+
+static void test_record()
+{
+    printf("test_record...\n");
+    am_Solver *solver, *replayed, *parent, *child;
+    am_Variable *x[8], *y, *src;
+    am_Constraint *c, *gaps[8];
+    am_VarEntry *ve = NULL;
+    ReplayLog log;
+    FILE *fp;
+    size_t count;
+    /* group counts past the end of the file, or whose size overflows */
+    static const unsigned char huge[] = { AM_REC_ADDGROUP, 0x81, 0x80, 0x80,
+        0x80, 0x80, 0x80, 0x80, 0x80, 0x20 };
+    static const unsigned char longgroup[] = { AM_REC_ADDGROUP, 3, 1, 1 };
+    /* ids that are 0 or already taken */
+    static const unsigned char zero[] = { AM_REC_NEWVARIABLE, 0 };
+    static const unsigned char twice[] = { AM_REC_NEWVARIABLE, 1,
+        AM_REC_NEWVARIABLE, 1 };
+    static const unsigned char zerocons[] = { AM_REC_NEWCONSTRAINT, 0,
+        0, 0, 0, 0, 0, 0, 0, 0 };
+    /* a variable deleted outright, then one freed with its constraint */
+    static const unsigned char deleted[] = { AM_REC_NEWVARIABLE, 1,
+        AM_REC_DELVARIABLE, 1, AM_REC_SUGGEST, 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    static const unsigned char released[] = { AM_REC_NEWVARIABLE, 1,
+        AM_REC_NEWCONSTRAINT, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+        AM_REC_ADDTERM, 1, 1, 0, 0, 0, 0, 0, 0, 0xf0, 0x3f,
+        AM_REC_DELVARIABLE, 1, AM_REC_DELCONSTRAINT, 1,
+        AM_REC_SUGGEST, 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    int i, ret = setjmp(jbuf);
+    if (ret < 0) {
+        perror("setjmp");
+        return;
+    }
+    else if (ret != 0) {
+        printf("out of memory!\n");
+        return;
+    }
+
+    solver = am_newsolver(debug_allocf, NULL);
+    am_autoupdate(solver, 1);
+    assert(am_record(solver, "am_record_test.amrc") == AM_OK);
+    for (i = 0; i < 8; ++i) {
+        x[i] = am_newvariable(solver);
+        new_constraint(solver, AM_WEAK, x[i], 1.0, AM_EQUAL, 30.0 * i, END);
+        if (i > 0)
+            gaps[i] = new_constraint(solver, AM_REQUIRED, x[i], 1.0,
+                                     AM_GREATEQUAL, 10.0, x[i - 1], 1.0, END);
+    }
+    assert(am_setbounds(x[0], 0.0, 100.0, AM_REQUIRED) == AM_OK);
+    y = am_newvariable(solver);
+    c = am_newconstraint(solver, AM_STRONG);
+    am_addterm(c, y, 1.0);
+    am_setrelation(c, AM_EQUAL);
+    am_mergeconstraint(c, gaps[3], 2.0);
+    assert(am_add(c) == AM_OK);
+    assert(am_add(am_cloneconstraint(gaps[5], AM_MEDIUM)) == AM_OK);
+    am_suggest(x[7], 150.0);
+    am_suggest(x[7], 400.0);
+    assert(am_disable(gaps[2]) == AM_OK);
+    am_suggest(x[0], 90.0);
+    assert(am_enablegroup(&gaps[2], 1) == AM_OK);
+    assert(am_suspendedit(x[7]) == AM_OK);
+    assert(am_sweep(x[0], 0.0, 60.0, x, 8, ignore_piece, NULL) == AM_OK);
+    assert(am_resumeedit(x[7]) == AM_OK);
+    assert(am_freeze(&x[1], 2) == AM_OK);
+    am_suggest(x[0], 20.0);
+    assert(am_thaw(&x[1], 2) == AM_OK);
+    am_remove(gaps[6]);
+    am_delconstraint(gaps[4]);
+    am_usevariable(y);
+    am_delvariable(y);
+    am_deledit(x[0]);
+    assert(am_record(solver, NULL) == AM_OK);
+    assert(am_record(solver, "am_record_test.amrc") == AM_FAILED);
+
+    /* the same calls on a new solver end in the same state */
+    memset(&log, 0, sizeof(log));
+    replayed = am_newsolver(debug_allocf, NULL);
+    assert(am_replay(replayed, "am_record_test.amrc", replay_log, &log) ==
+           AM_OK);
+    assert(log.open == 0 && log.adds == 8 + 7 + 2);
+    assert(log.suggests == 4);
+    assert(replayed->vars.count == solver->vars.count);
+    assert(replayed->constraints.count == solver->constraints.count);
+    assert(replayed->rows.count == solver->rows.count);
+    while (am_nextentry(&solver->vars, (am_Entry **)&ve)) {
+        am_VarEntry *other = NULL;
+        while (am_nextentry(&replayed->vars, (am_Entry **)&other))
+            if (am_variableid(other->variable) == am_variableid(ve->variable))
+                break;
+        assert(other != NULL);
+        assert(am_approx(am_value(ve->variable), am_value(other->variable)));
+    }
+    am_delsolver(replayed);
+
+    /* a cut off log fails after the calls it has */
+    fp = fopen("am_record_test.amrc", "ab");
+    putc(AM_REC_SUGGEST, fp);
+    fclose(fp);
+    replayed = am_newsolver(debug_allocf, NULL);
+    assert(am_replay(replayed, "am_record_test.amrc", NULL, NULL) ==
+           AM_FAILED);
+    assert(replayed->vars.count == solver->vars.count);
+    am_delsolver(replayed);
+    assert(am_replay(solver, "am_no_such_file.amrc", NULL, NULL) ==
+           AM_FAILED);
+
+    /* so do a relation out of range and a varint too long for a size_t */
+    fp = fopen("am_record_test.amrc", "wb");
+    fwrite("AMRC\1", 1, 5, fp);
+    putc(AM_REC_NEWCONSTRAINT, fp);
+    putc(1, fp);
+    for (i = 0; i < 8; ++i)
+        putc(0, fp);
+    putc(AM_REC_SETRELATION, fp);
+    putc(1, fp);
+    putc(9, fp);
+    fclose(fp);
+    replayed = am_newsolver(debug_allocf, NULL);
+    assert(am_replay(replayed, "am_record_test.amrc", NULL, NULL) ==
+           AM_FAILED);
+    am_delsolver(replayed);
+    fp = fopen("am_record_test.amrc", "wb");
+    fwrite("AMRC\1", 1, 5, fp);
+    putc(AM_REC_AUTOUPDATE, fp);
+    for (i = 0; i < 16; ++i)
+        putc(0xff, fp);
+    putc(1, fp);
+    fclose(fp);
+    replayed = am_newsolver(debug_allocf, NULL);
+    assert(am_replay(replayed, "am_record_test.amrc", NULL, NULL) ==
+           AM_FAILED);
+    assert(!replayed->auto_update);
+    am_delsolver(replayed);
+    assert(replay_bytes(huge, sizeof(huge), NULL) == AM_FAILED);
+    assert(replay_bytes(longgroup, sizeof(longgroup), NULL) == AM_FAILED);
+    assert(replay_bytes(zero, sizeof(zero), NULL) == AM_FAILED);
+    assert(replay_bytes(twice, sizeof(twice), &count) == AM_FAILED);
+    assert(count == 1);
+    assert(replay_bytes(zerocons, sizeof(zerocons), NULL) == AM_FAILED);
+
+    /* calls on a freed object find nothing */
+    assert(replay_bytes(deleted, sizeof(deleted), &count) == AM_OK);
+    assert(count == 0);
+    assert(replay_bytes(released, sizeof(released), &count) == AM_OK);
+    assert(count == 0);
+
+    /* values pulled from a source replay as one suggest each */
+    parent = am_newsolver(debug_allocf, NULL);
+    child = am_newsolver(debug_allocf, NULL);
+    src = am_newvariable(parent);
+    am_suggest(src, 10.0);
+    assert(am_record(child, "am_record_test.amrc") == AM_OK);
+    y = am_newvariable(child);
+    assert(am_bind(y, src, AM_STRONG) == AM_OK);
+    am_suggest(src, 30.0);
+    am_updatevars(child);
+    assert(am_approx(am_value(y), 30.0));
+    assert(am_record(child, NULL) == AM_OK);
+    memset(&log, 0, sizeof(log));
+    replayed = am_newsolver(debug_allocf, NULL);
+    assert(am_replay(replayed, "am_record_test.amrc", replay_log, &log) ==
+           AM_OK);
+    assert(log.suggests == 1);
+    ve = NULL;
+    assert(am_nextentry(&replayed->vars, (am_Entry **)&ve));
+    assert(am_approx(am_value(ve->variable), 30.0));
+    am_delsolver(replayed);
+    am_delsolver(child);
+    am_delsolver(parent);
+    remove("am_record_test.amrc");
+    am_delsolver(solver);
+
+    memory_assert(allmem == 0);
+    maxmem = 0;
+    printf("test_record passed\n");
+}
+
 int main()
 {
     clock_t start = clock();
@@ -938,6 +2904,27 @@ int main()
     test_binarytree();
     test_strength();
     test_unbounded();
+    test_disable();
+    test_suspendedit();
+    test_budget();
+    test_presolve();
+    test_bounds();
+    test_addgroup();
+    test_subject();
+    test_refactor();
+    test_refactor_rebuild();
+    test_columnindex();
+    test_sweep();
+    test_sense();
+    test_memo();
+    test_freeze();
+    test_diffsolve();
+    test_nested();
+    test_stats();
+    test_trace();
+    test_record();
+    test_latency();
+    test_health();
 
     clock_t end = clock();
     double elapsed_time = ((double) (end - start)) / CLOCKS_PER_SEC;